@@ -0,0 +1,402 @@
+//
+//  bvh.h
+//  3D Object Drawing
+//
+//  Bounding volume hierarchy over the scene's world-space boxes. Built top
+//  down with a binned surface area heuristic; when objects move (the fan
+//  blades) the node boxes are refit bottom up instead of rebuilding. Answers
+//  ray casts (mouse picking) and box overlap queries.
+//
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "frustum.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+// distance along the ray to the entry point of [boxMin, boxMax], FLT_MAX on a miss
+inline float rayBoxDistance(const glm::vec3& origin, const glm::vec3& inverseDirection,
+                            const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    glm::vec3 t0 = (boxMin - origin) * inverseDirection;
+    glm::vec3 t1 = (boxMax - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+class BVH
+{
+public:
+    static const int BIN_COUNT = 12;
+    static const int MAX_LEAF_SIZE = 4;
+
+    // 32 bytes; a leaf (count > 0) covers objects[leftFirst, leftFirst + count), an inner node has
+    // its children at leftFirst and leftFirst + 1
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        int leftFirst;
+        glm::vec3 boundsMax;
+        int count;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> objects;               // object ids (scene nodes) in leaf order
+    int depth;                              // edges from the root to the deepest leaf
+
+    BVH() : depth(0) {}
+
+    // build over the given ids; bounds holds one center/extent entry per id
+    // ------------------------------------------------------------------------
+    void build(const BoxBounds& bounds, const std::vector<int>& objectIds)
+    {
+        objects = objectIds;
+        nodes.clear();
+        depth = 0;
+        if (objects.empty())
+            return;
+        loadBoxes(bounds);
+
+        Node root;
+        root.leftFirst = 0;
+        root.count = (int)objects.size();
+        nodes.push_back(root);
+        fitLeaf(0);
+
+        // the SAH does not bound the depth: unevenly spread centroids can peel off one node per level
+        std::vector<int> level(1, 0);
+        std::vector<int> stack(1, 0);
+        while (!stack.empty())
+        {
+            int index = stack.back();
+            stack.pop_back();
+
+            int axis, splitBin;
+            if (!findSplit(index, axis, splitBin))
+                continue;
+
+            // partition the node's objects around the chosen bin boundary
+            int first = nodes[index].leftFirst;
+            int count = nodes[index].count;
+            float binMin, binScale;
+            centroidBins(index, axis, binMin, binScale);
+            int* begin = &objects[first];
+            int* middle = std::partition(begin, begin + count, [&](int object) {
+                return binOf(centroid(object)[axis], binMin, binScale) < splitBin;
+            });
+            int leftCount = (int)(middle - begin);
+            if (leftCount == 0 || leftCount == count)
+                continue;
+
+            int left = (int)nodes.size();
+            Node child;
+            child.leftFirst = first;
+            child.count = leftCount;
+            nodes.push_back(child);
+            child.leftFirst = first + leftCount;
+            child.count = count - leftCount;
+            nodes.push_back(child);
+            fitLeaf(left);
+            fitLeaf(left + 1);
+            level.push_back(level[index] + 1);
+            level.push_back(level[index] + 1);
+            depth = std::max(depth, level[index] + 1);
+
+            nodes[index].leftFirst = left;
+            nodes[index].count = 0;
+            stack.push_back(left);
+            stack.push_back(left + 1);
+        }
+    }
+    // objects moved but the set is the same: recompute every node box, children before parents
+    // ------------------------------------------------------------------------
+    void refit(const BoxBounds& bounds)
+    {
+        if (nodes.empty())
+            return;
+        loadBoxes(bounds);
+        // children are always created after their parent, so a reverse sweep sees them first
+        for (int i = (int)nodes.size() - 1; i >= 0; i--)
+        {
+            Node& node = nodes[i];
+            if (node.count > 0)
+            {
+                fitLeaf(i);
+            }
+            else
+            {
+                const Node& left = nodes[node.leftFirst];
+                const Node& right = nodes[node.leftFirst + 1];
+                node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+                node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+            }
+        }
+    }
+    // closest object whose box the ray hits, or -1; hitTest(object, distance) may refine the hit
+    // against the real shape and returns false to reject it
+    // ------------------------------------------------------------------------
+    template <typename HitTest>
+    int raycast(const glm::vec3& origin, const glm::vec3& direction, HitTest hitTest, float* hitDistance = NULL) const
+    {
+        int best = -1;
+        float bestDistance = FLT_MAX;
+        if (nodes.empty())
+            return best;
+
+        glm::vec3 inverseDirection = 1.0f / direction;
+        TraversalStack traversal(depth);
+        int* stack = traversal.entries;
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node& node = nodes[stack[--top]];
+            if (rayBoxDistance(origin, inverseDirection, node.boundsMin, node.boundsMax) >= bestDistance)
+                continue;
+
+            if (node.count > 0)
+            {
+                for (int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+                {
+                    int object = objects[i];
+                    float distance = rayBoxDistance(origin, inverseDirection, boxMin[object], boxMax[object]);
+                    if (distance < bestDistance && hitTest(object, distance) && distance < bestDistance)
+                    {
+                        best = object;
+                        bestDistance = distance;
+                    }
+                }
+                continue;
+            }
+
+            // visit the nearer child first so the farther one is usually rejected by bestDistance
+            int closer = node.leftFirst, farther = node.leftFirst + 1;
+            float closerDistance = rayBoxDistance(origin, inverseDirection, nodes[closer].boundsMin, nodes[closer].boundsMax);
+            float fartherDistance = rayBoxDistance(origin, inverseDirection, nodes[farther].boundsMin, nodes[farther].boundsMax);
+            if (closerDistance > fartherDistance)
+            {
+                std::swap(closer, farther);
+                std::swap(closerDistance, fartherDistance);
+            }
+            if (fartherDistance < bestDistance)
+                stack[top++] = farther;
+            if (closerDistance < bestDistance)
+                stack[top++] = closer;
+        }
+        if (hitDistance)
+            *hitDistance = bestDistance;
+        return best;
+    }
+    // ------------------------------------------------------------------------
+    int raycast(const glm::vec3& origin, const glm::vec3& direction, float* hitDistance = NULL) const
+    {
+        return raycast(origin, direction, [](int, float&) { return true; }, hitDistance);
+    }
+    // every object whose box overlaps [queryMin, queryMax]
+    // ------------------------------------------------------------------------
+    void overlap(const glm::vec3& queryMin, const glm::vec3& queryMax, std::vector<int>& result) const
+    {
+        result.clear();
+        if (nodes.empty())
+            return;
+
+        TraversalStack traversal(depth);
+        int* stack = traversal.entries;
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node& node = nodes[stack[--top]];
+            if (!boxesOverlap(node.boundsMin, node.boundsMax, queryMin, queryMax))
+                continue;
+
+            if (node.count > 0)
+            {
+                for (int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+                {
+                    if (boxesOverlap(boxMin[objects[i]], boxMax[objects[i]], queryMin, queryMax))
+                        result.push_back(objects[i]);
+                }
+            }
+            else
+            {
+                stack[top++] = node.leftFirst;
+                stack[top++] = node.leftFirst + 1;
+            }
+        }
+    }
+
+private:
+    // depth-first stack of a query; every level leaves at most one sibling behind, so depth + 2 entries
+    // always suffice. Ordinary trees fit in the fixed array, degenerate ones get a heap array.
+    struct TraversalStack
+    {
+        static const int FIXED_SIZE = 64;
+        int fixed[FIXED_SIZE];
+        std::vector<int> heap;
+        int* entries;
+
+        explicit TraversalStack(int treeDepth) : entries(fixed)
+        {
+            if (treeDepth + 2 > FIXED_SIZE)
+            {
+                heap.resize(treeDepth + 2);
+                entries = &heap[0];
+            }
+        }
+    };
+
+    std::vector<glm::vec3> boxMin, boxMax;  // per object id, copied out of BoxBounds
+
+    void loadBoxes(const BoxBounds& bounds)
+    {
+        boxMin.resize(bounds.centerX.size());
+        boxMax.resize(bounds.centerX.size());
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            int object = objects[i];
+            glm::vec3 center(bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]);
+            glm::vec3 extent(bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+            boxMin[object] = center - extent;
+            boxMax[object] = center + extent;
+        }
+    }
+
+    glm::vec3 centroid(int object) const
+    {
+        return (boxMin[object] + boxMax[object]) * 0.5f;
+    }
+
+    static bool boxesOverlap(const glm::vec3& aMin, const glm::vec3& aMax, const glm::vec3& bMin, const glm::vec3& bMax)
+    {
+        return aMin.x <= bMax.x && aMax.x >= bMin.x
+            && aMin.y <= bMax.y && aMax.y >= bMin.y
+            && aMin.z <= bMax.z && aMax.z >= bMin.z;
+    }
+
+    static float surfaceArea(const glm::vec3& extentMin, const glm::vec3& extentMax)
+    {
+        glm::vec3 size = extentMax - extentMin;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    static int binOf(float value, float binMin, float binScale)
+    {
+        return std::min(BIN_COUNT - 1, (int)((value - binMin) * binScale));
+    }
+
+    void fitLeaf(int index)
+    {
+        Node& node = nodes[index];
+        node.boundsMin = glm::vec3(FLT_MAX);
+        node.boundsMax = glm::vec3(-FLT_MAX);
+        for (int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+        {
+            node.boundsMin = glm::min(node.boundsMin, boxMin[objects[i]]);
+            node.boundsMax = glm::max(node.boundsMax, boxMax[objects[i]]);
+        }
+    }
+
+    // bins span the centroids (not the boxes) of the node's objects along one axis
+    void centroidBins(int index, int axis, float& binMin, float& binScale) const
+    {
+        const Node& node = nodes[index];
+        float lo = FLT_MAX, hi = -FLT_MAX;
+        for (int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+        {
+            float c = centroid(objects[i])[axis];
+            lo = std::min(lo, c);
+            hi = std::max(hi, c);
+        }
+        binMin = lo;
+        binScale = hi > lo ? BIN_COUNT / (hi - lo) : 0.0f;
+    }
+
+    // cheapest binned SAH split over all three axes; false when staying a leaf is cheaper
+    bool findSplit(int index, int& bestAxis, int& bestBin) const
+    {
+        const Node& node = nodes[index];
+        if (node.count <= 1)
+            return false;
+
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float binMin, binScale;
+            centroidBins(index, axis, binMin, binScale);
+            if (binScale == 0.0f)
+                continue;
+
+            glm::vec3 binLo[BIN_COUNT], binHi[BIN_COUNT];
+            int binCount[BIN_COUNT];
+            for (int b = 0; b < BIN_COUNT; b++)
+            {
+                binLo[b] = glm::vec3(FLT_MAX);
+                binHi[b] = glm::vec3(-FLT_MAX);
+                binCount[b] = 0;
+            }
+            for (int i = node.leftFirst; i < node.leftFirst + node.count; i++)
+            {
+                int object = objects[i];
+                int b = binOf(centroid(object)[axis], binMin, binScale);
+                binLo[b] = glm::min(binLo[b], boxMin[object]);
+                binHi[b] = glm::max(binHi[b], boxMax[object]);
+                binCount[b]++;
+            }
+
+            // sweep from the left and from the right to get the area and count on each side of every plane
+            float leftArea[BIN_COUNT - 1], rightArea[BIN_COUNT - 1];
+            int leftCount[BIN_COUNT - 1], rightCount[BIN_COUNT - 1];
+            glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+            int sum = 0;
+            for (int b = 0; b < BIN_COUNT - 1; b++)
+            {
+                lo = glm::min(lo, binLo[b]);
+                hi = glm::max(hi, binHi[b]);
+                sum += binCount[b];
+                leftCount[b] = sum;
+                leftArea[b] = sum > 0 ? surfaceArea(lo, hi) : 0.0f;
+            }
+            lo = glm::vec3(FLT_MAX);
+            hi = glm::vec3(-FLT_MAX);
+            sum = 0;
+            for (int b = BIN_COUNT - 1; b > 0; b--)
+            {
+                lo = glm::min(lo, binLo[b]);
+                hi = glm::max(hi, binHi[b]);
+                sum += binCount[b];
+                rightCount[b - 1] = sum;
+                rightArea[b - 1] = sum > 0 ? surfaceArea(lo, hi) : 0.0f;
+            }
+
+            for (int b = 0; b < BIN_COUNT - 1; b++)
+            {
+                if (leftCount[b] == 0 || rightCount[b] == 0)
+                    continue;
+                float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b + 1;
+                }
+            }
+        }
+
+        float leafCost = node.count * surfaceArea(node.boundsMin, node.boundsMax);
+        // small leaves are fine even when a split would be marginally cheaper
+        if (node.count <= MAX_LEAF_SIZE && bestCost >= leafCost)
+            return false;
+        return bestCost < FLT_MAX;
+    }
+};
+
+#endif
@@ -0,0 +1,385 @@
+//
+//  clustered_lights.h
+//  3D Object Drawing
+//
+//  Clustered forward lighting. The view frustum is cut into a grid of
+//  TILES_X x TILES_Y screen tiles and SLICES depth slices (spaced
+//  logarithmically, so near clusters are as deep as they are wide). Every
+//  frame the point lights are moved into view space and each cluster gets
+//  the list of lights whose sphere reaches its view-space box, one job per
+//  slice. The lit fragment shaders (fragmentShaderLit.fs) find their
+//  cluster and loop over that list only.
+//
+//  GL 3.3 has no storage buffers, so the data goes up in three texture
+//  buffers, rewritten every frame by orphaning:
+//    lights        RGBA32F, 2 texels a light: view position + radius, color
+//    clusters      RG32UI, one texel a cluster: first index, light count
+//    lightIndices  R32UI, the cluster lists back to back
+//  plus the ClusterData uniform block with the grid parameters.
+//
+
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "job_system.h"
+#include "ring_buffer.h"
+#include "scene_graph.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// binding point of the ClusterData block (FrameData is on 0)
+const GLuint CLUSTER_DATA_BINDING = 1;
+// texture units of the three light buffers
+const GLuint LIGHT_TEXTURE_UNIT = 0;
+const GLuint CLUSTER_TEXTURE_UNIT = 1;
+const GLuint LIGHT_INDEX_TEXTURE_UNIT = 2;
+
+// a point light carried by a scene node: it sits at offset in the node's frame and follows it
+struct PointLight
+{
+    int node;
+    glm::vec3 offset;
+    glm::vec3 color;        // premultiplied by the intensity
+    float radius;           // the light fades to nothing here
+};
+
+// mirrors the std140 layout of the ClusterData block
+struct ClusterData
+{
+    uint32_t gridSize[4];   // tiles x, tiles y, slices, unused
+    float slicing[4];       // slice = log(depth) * slicing[0] + slicing[1]
+    float ambient[4];       // rgb, a unused
+};
+
+class LightClusters
+{
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 12;
+    static const int SLICES = 24;
+    static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+    // last frame, for the headless report
+    size_t visibleLights;
+    size_t assignedIndices;
+    size_t busiestCluster;
+
+    LightClusters() : visibleLights(0), assignedIndices(0), busiestCluster(0), UBO(0), nearPlane(0.1f), farPlane(100.0f),
+                      maxIndices(0), boundsProjection(0.0f)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            textures[i] = 0;
+            attached[i] = 0;
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    void init(float nearDepth, float farDepth, const glm::vec3& ambientColor)
+    {
+        nearPlane = nearDepth;
+        farPlane = farDepth;
+        ambient = ambientColor;
+        slices.resize(SLICES);
+        grid.resize(CLUSTER_COUNT * 2);
+        boxMin.resize(CLUSTER_COUNT);
+        boxMax.resize(CLUSTER_COUNT);
+
+        GLint textureBufferSize = 65536;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &textureBufferSize);
+        maxIndices = (size_t)textureBufferSize;
+
+        // the orphaning path of the ring: texture buffers cannot be pointed at an offset before GL 4.3
+        lights.init(GL_TEXTURE_BUFFER, 1, false);
+        clusters.init(GL_TEXTURE_BUFFER, 1, false);
+        indices.init(GL_TEXTURE_BUFFER, 1, false);
+        glGenTextures(3, textures);
+
+        glGenBuffers(1, &UBO);
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterData), NULL, GL_DYNAMIC_DRAW);
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
+        GLState::instance().bindBufferBase(GL_UNIFORM_BUFFER, CLUSTER_DATA_BINDING, UBO);
+    }
+    // point a lit program at the block and the texture units; programs without them are left alone
+    // ------------------------------------------------------------------------
+    void attach(const Shader& shader) const
+    {
+        shader.bindUniformBlock("ClusterData", CLUSTER_DATA_BINDING);
+        shader.use();
+        shader.setInt("lights", LIGHT_TEXTURE_UNIT);
+        shader.setInt("clusters", CLUSTER_TEXTURE_UNIT);
+        shader.setInt("lightIndices", LIGHT_INDEX_TEXTURE_UNIT);
+    }
+    // assign this frame's lights to the clusters and upload everything; GL thread only
+    // ------------------------------------------------------------------------
+    void update(JobSystem& jobs, const SceneGraph& scene, const std::vector<PointLight>& pointLights,
+                const glm::mat4& view, const glm::mat4& projection)
+    {
+        if (projection != boundsProjection)
+            computeBounds(projection);
+        gatherLights(scene, pointLights, view, projection);
+
+        // one job per slice; every slice fills its own part of grid and its own index list
+        jobs.parallelFor(SLICES, [&](int slice, int) {
+            assignSlice(slice);
+        });
+
+        size_t total = 0;
+        busiestCluster = 0;
+        for (int slice = 0; slice < SLICES; slice++)
+        {
+            size_t base = total;
+            total += slices[slice].indices.size();
+            for (int cell = 0; cell < TILES_X * TILES_Y; cell++)
+            {
+                uint32_t* entry = &grid[(slice * TILES_X * TILES_Y + cell) * 2];
+                entry[0] += (uint32_t)base;
+                busiestCluster = std::max(busiestCluster, (size_t)entry[1]);
+                // a list that does not fit the texture buffer is cut short, the cluster loses those lights
+                if (entry[0] + (size_t)entry[1] > maxIndices)
+                    entry[1] = entry[0] >= maxIndices ? 0 : (uint32_t)(maxIndices - entry[0]);
+            }
+        }
+        assignedIndices = std::min(total, maxIndices);
+        upload();
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        lights.destroy();
+        clusters.destroy();
+        indices.destroy();
+        glDeleteTextures(3, textures);
+        GLState::instance().deleteBuffer(UBO);
+        UBO = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            textures[i] = 0;
+            attached[i] = 0;
+        }
+    }
+
+private:
+    // a light in view space with the clusters it can reach
+    struct ViewLight
+    {
+        glm::vec3 position;
+        float radius;
+        glm::vec3 color;
+        int firstSlice, lastSlice;
+        int firstTileX, lastTileX, firstTileY, lastTileY;
+    };
+    struct Slice
+    {
+        std::vector<int> candidates;        // lights whose depth range reaches the slice
+        std::vector<uint32_t> indices;      // the slice's cluster lists, cluster by cluster
+    };
+
+    unsigned int UBO;
+    unsigned int textures[3];               // lights, clusters, lightIndices
+    unsigned int attached[3];               // buffer each texture was last pointed at
+    RingBuffer lights, clusters, indices;
+    float nearPlane, farPlane;
+    glm::vec3 ambient;
+    size_t maxIndices;
+    std::vector<ViewLight> viewLights;
+    std::vector<Slice> slices;
+    std::vector<uint32_t> grid;             // first index and count per cluster
+    glm::mat4 boundsProjection;
+    std::vector<glm::vec3> boxMin, boxMax;  // view-space box of every cluster
+
+    float sliceDepth(int slice) const
+    {
+        return nearPlane * std::pow(farPlane / nearPlane, (float)slice / SLICES);
+    }
+    int sliceOf(float depth) const
+    {
+        if (depth <= nearPlane)
+            return 0;
+        int slice = (int)(std::log(depth / nearPlane) / std::log(farPlane / nearPlane) * SLICES);
+        return std::min(slice, SLICES - 1);
+    }
+
+    // the boxes only change with the projection (zoom)
+    void computeBounds(const glm::mat4& projection)
+    {
+        boundsProjection = projection;
+        // a symmetric perspective maps view (x, y) at depth d to NDC x * p00 / d, y * p11 / d
+        float p00 = projection[0][0], p11 = projection[1][1];
+        for (int slice = 0; slice < SLICES; slice++)
+        {
+            float nearDepth = sliceDepth(slice), farDepth = sliceDepth(slice + 1);
+            for (int y = 0; y < TILES_Y; y++)
+            {
+                for (int x = 0; x < TILES_X; x++)
+                {
+                    float ndcX0 = -1.0f + 2.0f * x / TILES_X, ndcX1 = -1.0f + 2.0f * (x + 1) / TILES_X;
+                    float ndcY0 = -1.0f + 2.0f * y / TILES_Y, ndcY1 = -1.0f + 2.0f * (y + 1) / TILES_Y;
+                    // x = ndc * depth / p00 is bilinear, so its extremes over the cluster are at the corners
+                    float xs[4] = { ndcX0 * nearDepth / p00, ndcX1 * nearDepth / p00, ndcX0 * farDepth / p00, ndcX1 * farDepth / p00 };
+                    float ys[4] = { ndcY0 * nearDepth / p11, ndcY1 * nearDepth / p11, ndcY0 * farDepth / p11, ndcY1 * farDepth / p11 };
+                    int cluster = (slice * TILES_Y + y) * TILES_X + x;
+                    boxMin[cluster] = glm::vec3(*std::min_element(xs, xs + 4), *std::min_element(ys, ys + 4), -farDepth);
+                    boxMax[cluster] = glm::vec3(*std::max_element(xs, xs + 4), *std::max_element(ys, ys + 4), -nearDepth);
+                }
+            }
+        }
+    }
+
+    // view-space lights and the range of clusters each one can touch; lights out of view are dropped
+    void gatherLights(const SceneGraph& scene, const std::vector<PointLight>& pointLights, const glm::mat4& view,
+                      const glm::mat4& projection)
+    {
+        viewLights.clear();
+        for (size_t i = 0; i < pointLights.size(); i++)
+        {
+            const PointLight& light = pointLights[i];
+            glm::vec4 world = scene.world[light.node] * glm::vec4(light.offset, 1.0f);
+            ViewLight v;
+            v.position = glm::vec3(view * world);
+            v.radius = light.radius;
+            v.color = light.color;
+            float depth = -v.position.z;
+            if (depth + v.radius < nearPlane || depth - v.radius > farPlane)
+                continue;
+            v.firstSlice = sliceOf(depth - v.radius);
+            v.lastSlice = sliceOf(depth + v.radius);
+
+            v.firstTileX = v.firstTileY = 0;
+            v.lastTileX = TILES_X - 1;
+            v.lastTileY = TILES_Y - 1;
+            // a sphere clear of the near plane covers at most the screen rectangle of its bounding box
+            if (depth - v.radius > nearPlane)
+            {
+                float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    glm::vec3 p = v.position + glm::vec3((corner & 1) ? v.radius : -v.radius, (corner & 2) ? v.radius : -v.radius,
+                                                         (corner & 4) ? v.radius : -v.radius);
+                    glm::vec4 clip = projection * glm::vec4(p, 1.0f);
+                    minX = std::min(minX, clip.x / clip.w); maxX = std::max(maxX, clip.x / clip.w);
+                    minY = std::min(minY, clip.y / clip.w); maxY = std::max(maxY, clip.y / clip.w);
+                }
+                if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+                    continue;
+                v.firstTileX = std::max(0, (int)std::floor((minX * 0.5f + 0.5f) * TILES_X));
+                v.lastTileX = std::min(TILES_X - 1, (int)std::floor((maxX * 0.5f + 0.5f) * TILES_X));
+                v.firstTileY = std::max(0, (int)std::floor((minY * 0.5f + 0.5f) * TILES_Y));
+                v.lastTileY = std::min(TILES_Y - 1, (int)std::floor((maxY * 0.5f + 0.5f) * TILES_Y));
+            }
+            viewLights.push_back(v);
+        }
+        visibleLights = viewLights.size();
+    }
+
+    void assignSlice(int slice)
+    {
+        Slice& s = slices[slice];
+        s.candidates.clear();
+        s.indices.clear();
+        for (size_t i = 0; i < viewLights.size(); i++)
+        {
+            if (viewLights[i].firstSlice <= slice && slice <= viewLights[i].lastSlice)
+                s.candidates.push_back((int)i);
+        }
+
+        for (int y = 0; y < TILES_Y; y++)
+        {
+            for (int x = 0; x < TILES_X; x++)
+            {
+                int cluster = (slice * TILES_Y + y) * TILES_X + x;
+                uint32_t first = (uint32_t)s.indices.size();
+                for (size_t c = 0; c < s.candidates.size(); c++)
+                {
+                    const ViewLight& light = viewLights[s.candidates[c]];
+                    if (x < light.firstTileX || x > light.lastTileX || y < light.firstTileY || y > light.lastTileY)
+                        continue;
+                    // sphere against box: distance from the center to the closest point of the box
+                    const glm::vec3& lo = boxMin[cluster];
+                    const glm::vec3& hi = boxMax[cluster];
+                    glm::vec3 closest(std::min(std::max(light.position.x, lo.x), hi.x), std::min(std::max(light.position.y, lo.y), hi.y),
+                                      std::min(std::max(light.position.z, lo.z), hi.z));
+                    glm::vec3 d = closest - light.position;
+                    if (glm::dot(d, d) <= light.radius * light.radius)
+                        s.indices.push_back((uint32_t)s.candidates[c]);
+                }
+                grid[cluster * 2] = first;      // relative to the slice until update() adds the slice's base
+                grid[cluster * 2 + 1] = (uint32_t)s.indices.size() - first;
+            }
+        }
+    }
+
+    void upload()
+    {
+        // never empty, so every texture always has a buffer behind it
+        size_t lightBytes = std::max<size_t>(viewLights.size(), 1) * 2 * sizeof(glm::vec4);
+        glm::vec4* lightData = (glm::vec4*)lights.begin(lightBytes);
+        for (size_t i = 0; i < viewLights.size(); i++)
+        {
+            lightData[i * 2] = glm::vec4(viewLights[i].position, viewLights[i].radius);
+            lightData[i * 2 + 1] = glm::vec4(viewLights[i].color, 0.0f);
+        }
+        lights.end(lightBytes);
+
+        void* gridData = clusters.begin(grid.size() * sizeof(uint32_t));
+        memcpy(gridData, grid.data(), grid.size() * sizeof(uint32_t));
+        clusters.end(grid.size() * sizeof(uint32_t));
+
+        size_t indexBytes = std::max<size_t>(assignedIndices, 1) * sizeof(uint32_t);
+        uint32_t* indexData = (uint32_t*)indices.begin(indexBytes);
+        size_t written = 0;
+        for (int slice = 0; slice < SLICES && written < assignedIndices; slice++)
+        {
+            size_t count = std::min(slices[slice].indices.size(), assignedIndices - written);
+            if (count > 0)
+                memcpy(indexData + written, slices[slice].indices.data(), count * sizeof(uint32_t));
+            written += count;
+        }
+        indices.end(indexBytes);
+
+        attach(0, lights.buffer, GL_RGBA32F, LIGHT_TEXTURE_UNIT);
+        attach(1, clusters.buffer, GL_RG32UI, CLUSTER_TEXTURE_UNIT);
+        attach(2, indices.buffer, GL_R32UI, LIGHT_INDEX_TEXTURE_UNIT);
+
+        ClusterData data;
+        data.gridSize[0] = TILES_X;
+        data.gridSize[1] = TILES_Y;
+        data.gridSize[2] = SLICES;
+        data.gridSize[3] = 0;
+        float scale = SLICES / std::log(farPlane / nearPlane);
+        data.slicing[0] = scale;
+        data.slicing[1] = -std::log(nearPlane) * scale;
+        data.slicing[2] = data.slicing[3] = 0.0f;
+        data.ambient[0] = ambient.x;
+        data.ambient[1] = ambient.y;
+        data.ambient[2] = ambient.z;
+        data.ambient[3] = 0.0f;
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ClusterData), &data);
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // orphaning keeps the buffer name, so a texture is only pointed at its buffer once
+    void attach(int texture, unsigned int buffer, GLenum format, GLuint unit)
+    {
+        if (attached[texture] == buffer)
+            return;
+        attached[texture] = buffer;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[texture]);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glActiveTexture(GL_TEXTURE0);
+    }
+};
+
+#endif
@@ -0,0 +1,242 @@
+//
+//  draw_queue.h
+//  3D Object Drawing
+//
+//  Per-frame draw queue. Every draw carries a 64-bit sort key, most
+//  significant field first:
+//
+//    63..62 pass | 61..56 program | 55..48 VAO | 47..38 coarse depth |
+//    37..14 color (RGB8) | 13..0 fine depth
+//
+//  The program and VAO fields are not GL names but dense indices in the
+//  order the queue first saw each program and VAO this frame, so names
+//  that grow across hot reloads never alias into the same group. They are
+//  assigned by add() and reassigned when queues are merged with append().
+//
+//  The keys are radix sorted (8 bits per pass, passes where all keys share
+//  the byte are skipped), so draws end up grouped by program and VAO and
+//  run front to back within a group, in 1024 depth bands. Inside a band
+//  draws of one color are adjacent and sorted by the rest of the depth.
+//  submit() then only touches GL state where consecutive draws differ.
+//
+
+#ifndef DRAW_QUEUE_H
+#define DRAW_QUEUE_H
+
+#include "shader.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class DrawQueue
+{
+public:
+    enum Pass
+    {
+        PASS_OPAQUE = 0
+    };
+
+    struct Item
+    {
+        glm::mat4 model;
+        glm::vec4 color;
+        const Shader* shader;
+        unsigned int VAO;
+        GLsizei indexCount;
+        GLenum indexType;
+    };
+
+    // state changes done by the last submit()
+    unsigned int programChanges, vaoChanges, colorChanges;
+
+    DrawQueue() : programChanges(0), vaoChanges(0), colorChanges(0) {}
+
+    // depth01 is the distance to the camera scaled to [0, 1]; smaller sorts first. The program and VAO
+    // fields are left empty for add() to fill in
+    // ------------------------------------------------------------------------
+    static uint64_t makeKey(Pass pass, const glm::vec4& color, float depth01)
+    {
+        uint64_t r = (uint64_t)(std::min(std::max(color.x, 0.0f), 1.0f) * 255.0f + 0.5f);
+        uint64_t g = (uint64_t)(std::min(std::max(color.y, 0.0f), 1.0f) * 255.0f + 0.5f);
+        uint64_t b = (uint64_t)(std::min(std::max(color.z, 0.0f), 1.0f) * 255.0f + 0.5f);
+        // 24 bits of depth, split around the color: the top 10 order the draws, the low 14 order one color in a band
+        uint64_t depth = (uint64_t)(std::min(std::max(depth01, 0.0f), 1.0f) * 16777215.0f);
+        return ((uint64_t)pass << 62) | ((depth >> 14) << 38) | (r << 30) | (g << 22) | (b << 14) | (depth & 0x3FFF);
+    }
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        keys.clear();
+        items.clear();
+        programs.clear();
+        vertexArrays.clear();
+    }
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        return items.size();
+    }
+    // ------------------------------------------------------------------------
+    void add(uint64_t key, const glm::mat4& model, const glm::vec4& color, const Shader& shader, unsigned int VAO, GLsizei indexCount,
+             GLenum indexType = GL_UNSIGNED_INT)
+    {
+        Item item;
+        item.model = model;
+        item.color = color;
+        item.shader = &shader;
+        item.VAO = VAO;
+        item.indexCount = indexCount;
+        item.indexType = indexType;
+        keys.push_back(key | stateBits(shader.ID, VAO));
+        items.push_back(item);
+    }
+    // take over the draws of a queue filled elsewhere (e.g. by a job); its program and VAO indices are
+    // replaced by this queue's own
+    // ------------------------------------------------------------------------
+    void append(const DrawQueue& other)
+    {
+        for (size_t i = 0; i < other.keys.size(); i++)
+        {
+            const Item& item = other.items[i];
+            keys.push_back((other.keys[i] & ~STATE_MASK) | stateBits(item.shader->ID, item.VAO));
+        }
+        items.insert(items.end(), other.items.begin(), other.items.end());
+    }
+    // LSD radix sort of the keys; equal keys keep their submission order
+    // ------------------------------------------------------------------------
+    void sort()
+    {
+        size_t count = keys.size();
+        sorted.resize(count);
+        scratch.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            sorted[i].key = keys[i];
+            sorted[i].index = (unsigned int)i;
+        }
+        if (count < 2)
+            return;
+
+        // all eight histograms in one read of the keys
+        size_t histogram[8][256] = {};
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int byte = 0; byte < 8; byte++)
+                histogram[byte][(keys[i] >> (byte * 8)) & 0xFF]++;
+        }
+
+        for (int byte = 0; byte < 8; byte++)
+        {
+            size_t* buckets = histogram[byte];
+            // every key has the same value in this byte: the pass would not move anything
+            if (buckets[(keys[0] >> (byte * 8)) & 0xFF] == count)
+                continue;
+
+            size_t offset = 0;
+            for (int b = 0; b < 256; b++)
+            {
+                size_t n = buckets[b];
+                buckets[b] = offset;
+                offset += n;
+            }
+            for (size_t i = 0; i < count; i++)
+                scratch[buckets[(sorted[i].key >> (byte * 8)) & 0xFF]++] = sorted[i];
+            sorted.swap(scratch);
+        }
+    }
+    // i-th draw in key order; valid after sort()
+    // ------------------------------------------------------------------------
+    const Item& operator[](size_t i) const
+    {
+        return items[sorted[i].index];
+    }
+    // issue the sorted draws; program, VAO and color are only set where they differ from the previous draw
+    // ------------------------------------------------------------------------
+    void submit()
+    {
+        programChanges = vaoChanges = colorChanges = 0;
+        submit(0, sorted.size());
+    }
+    // issue sorted draws [begin, end) only; the state changes are added to the counters
+    // ------------------------------------------------------------------------
+    void submit(size_t begin, size_t end)
+    {
+        const Shader* boundShader = NULL;
+        unsigned int boundVAO = 0;
+        glm::vec4 boundColor;
+        Shader::Uniform modelUniform, colorUniform;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            const Item& item = items[sorted[i].index];
+            if (item.shader != boundShader)
+            {
+                item.shader->use();
+                modelUniform = item.shader->uniform("model");
+                colorUniform = item.shader->uniform("color");
+                boundShader = item.shader;
+                programChanges++;
+                // uniform values belong to the program, so the color has to be set again
+                boundColor = glm::vec4(-1.0f);
+            }
+            if (item.VAO != boundVAO)
+            {
+                GLState::instance().bindVertexArray(item.VAO);
+                boundVAO = item.VAO;
+                vaoChanges++;
+            }
+            if (item.color != boundColor)
+            {
+                item.shader->setVec4(colorUniform, item.color);
+                boundColor = item.color;
+                colorChanges++;
+            }
+            item.shader->setMat4(modelUniform, item.model);
+            glDrawElements(GL_TRIANGLES, item.indexCount, item.indexType, 0);
+        }
+    }
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        unsigned int index;
+    };
+
+    static const uint64_t STATE_MASK = 0x3FFFull << 48;   // program and VAO fields
+
+    std::vector<uint64_t> keys;
+    std::vector<Item> items;
+    std::vector<unsigned int> programs;     // GL name of each dense program index, in first-seen order
+    std::vector<unsigned int> vertexArrays; // the same for VAOs
+    std::vector<SortEntry> sorted;      // (key, item index) in key order after sort()
+    std::vector<SortEntry> scratch;
+
+    // key bits of the dense program and VAO indices, assigning new indices to names not seen yet
+    // ------------------------------------------------------------------------
+    uint64_t stateBits(unsigned int program, unsigned int VAO)
+    {
+        return ((uint64_t)denseIndex(programs, program, 0x3F) << 56) | ((uint64_t)denseIndex(vertexArrays, VAO, 0xFF) << 48);
+    }
+    // a frame rarely uses more than a few programs and VAOs, so a linear search is enough. Names beyond
+    // what the field holds share its last index; they only sort less tightly, the draws stay correct
+    // ------------------------------------------------------------------------
+    static unsigned int denseIndex(std::vector<unsigned int>& names, unsigned int name, unsigned int last)
+    {
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (names[i] == name)
+                return (unsigned int)i;
+        }
+        if (names.size() > last)
+            return last;
+        names.push_back(name);
+        return (unsigned int)names.size() - 1;
+    }
+};
+
+#endif
@@ -0,0 +1,75 @@
+#version 330 core
+// Blinn-Phong over the lights of this fragment's cluster, see clustered_lights.h.
+// VERTEX_COLOR takes the color from the vertex shader instead of the uniform.
+#ifdef VERTEX_COLOR
+in vec4 color;
+#else
+uniform vec4 color;
+#endif
+in vec3 viewPosition;
+in vec3 viewNormal;
+
+out vec4 FragColor;
+
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+layout (std140) uniform ClusterData
+{
+    uvec4 gridSize;     // tiles x, tiles y, slices
+    vec4 slicing;       // slice = log(depth) * slicing.x + slicing.y
+    vec4 ambient;
+};
+
+uniform samplerBuffer lights;           // view position + radius, color
+uniform usamplerBuffer clusters;        // first index, count
+uniform usamplerBuffer lightIndices;
+
+const float SPECULAR = 0.3f;
+const float SHININESS = 32.0f;
+
+void main()
+{
+    vec4 clip = projection * vec4(viewPosition, 1.0f);
+    vec2 ndc = clip.xy / clip.w;
+    uvec3 cell;
+    cell.x = uint(clamp(int((ndc.x * 0.5f + 0.5f) * float(gridSize.x)), 0, int(gridSize.x) - 1));
+    cell.y = uint(clamp(int((ndc.y * 0.5f + 0.5f) * float(gridSize.y)), 0, int(gridSize.y) - 1));
+    cell.z = uint(clamp(int(log(-viewPosition.z) * slicing.x + slicing.y), 0, int(gridSize.z) - 1));
+    uvec2 list = texelFetch(clusters, int((cell.z * gridSize.y + cell.y) * gridSize.x + cell.x)).xy;
+
+    // faces seen from behind (inside a box, mirrored boxes) are lit from the side the viewer is on
+    vec3 N = normalize(viewNormal);
+    vec3 V = normalize(-viewPosition);
+    if (dot(N, V) < 0.0f)
+        N = -N;
+
+    vec3 diffuse = ambient.rgb;
+    vec3 specular = vec3(0.0f);
+    for (uint i = 0u; i < list.y; i++)
+    {
+        int light = int(texelFetch(lightIndices, int(list.x + i)).r);
+        vec4 positionRadius = texelFetch(lights, 2 * light);
+        vec3 lightColor = texelFetch(lights, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - viewPosition;
+        float distance2 = dot(toLight, toLight);
+        // smooth window: full strength at the light, nothing at the radius
+        float falloff = clamp(1.0f - distance2 / (positionRadius.w * positionRadius.w), 0.0f, 1.0f);
+        falloff *= falloff;
+        if (falloff == 0.0f)
+            continue;
+
+        vec3 L = toLight * inversesqrt(distance2);
+        vec3 H = normalize(L + V);
+        diffuse += lightColor * (max(dot(N, L), 0.0f) * falloff);
+        specular += lightColor * (pow(max(dot(N, H), 0.0f), SHININESS) * SPECULAR * falloff);
+    }
+    FragColor = vec4(color.rgb * diffuse + specular, color.a);
+}
@@ -0,0 +1,79 @@
+//
+//  frame_uniforms.h
+//  3D Object Drawing
+//
+//  Per-frame camera data shared by every program through one std140
+//  uniform block ("FrameData" in the vertex shaders). The buffer is
+//  written once per frame, however many programs or passes use it.
+//
+
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "shader.h"
+
+// binding point the FrameData block of every program is attached to
+const GLuint FRAME_DATA_BINDING = 0;
+
+// mirrors the std140 layout of the FrameData block
+struct FrameData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPosition;   // w unused
+    float time;
+    float padding[3];           // std140 rounds the block up to a multiple of 16 bytes
+};
+
+class FrameUniformBuffer
+{
+public:
+    unsigned int UBO;
+
+    FrameUniformBuffer() : UBO(0) {}
+
+    // ------------------------------------------------------------------------
+    void init()
+    {
+        glGenBuffers(1, &UBO);
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
+        // the buffer stays on its binding point for the lifetime of the program
+        GLState::instance().bindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, UBO);
+    }
+    // point a program's FrameData block at the shared binding; programs without the block are left alone
+    // ------------------------------------------------------------------------
+    void attach(const Shader& shader) const
+    {
+        shader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+    }
+    // ------------------------------------------------------------------------
+    void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float time)
+    {
+        FrameData data;
+        data.view = view;
+        data.projection = projection;
+        data.viewProjection = projection * view;
+        data.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+        data.time = time;
+        data.padding[0] = data.padding[1] = data.padding[2] = 0.0f;
+
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        GLState::instance().deleteBuffer(UBO);
+        UBO = 0;
+    }
+};
+
+#endif
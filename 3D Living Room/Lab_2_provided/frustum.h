@@ -0,0 +1,132 @@
+//
+//  frustum.h
+//  3D Object Drawing
+//
+//  View-frustum culling. Frustum planes come straight out of the
+//  projection * view matrix; world-space boxes are kept as contiguous
+//  center/extent arrays so the plane test runs on four boxes at a time with
+//  SSE (scalar fallback elsewhere).
+//
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE 1
+#endif
+
+struct Frustum
+{
+    glm::vec4 planes[6];    // (normal, d): a point p is inside when dot(normal, p) + d >= 0
+
+    // Gribb/Hartmann extraction; glm is column-major so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    // ------------------------------------------------------------------------
+    void extract(const glm::mat4& viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        planes[0] = rows[3] + rows[0];  // left
+        planes[1] = rows[3] - rows[0];  // right
+        planes[2] = rows[3] + rows[1];  // bottom
+        planes[3] = rows[3] - rows[1];  // top
+        planes[4] = rows[3] + rows[2];  // near
+        planes[5] = rows[3] - rows[2];  // far
+        // the test only compares signs, so the planes are left unnormalized
+    }
+};
+
+// world-space AABBs as center/half-extent component arrays, padded to a multiple of four
+class BoxBounds
+{
+public:
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    // ------------------------------------------------------------------------
+    void resize(size_t count)
+    {
+        size_t padded = (count + 3) & ~(size_t)3;
+        if (padded == centerX.size())
+            return;
+        centerX.resize(padded, 0.0f); centerY.resize(padded, 0.0f); centerZ.resize(padded, 0.0f);
+        extentX.resize(padded, 0.0f); extentY.resize(padded, 0.0f); extentZ.resize(padded, 0.0f);
+    }
+    // bounds of the box [localMin, localMax] carried into world space by model
+    // ------------------------------------------------------------------------
+    void set(size_t index, const glm::mat4& model, const glm::vec3& localMin, const glm::vec3& localMax)
+    {
+        glm::vec3 localCenter = (localMin + localMax) * 0.5f;
+        glm::vec3 localExtent = (localMax - localMin) * 0.5f;
+        glm::vec3 center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+        // each world axis gathers the absolute contribution of every local axis (Arvo)
+        glm::vec3 extent(0.0f);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int local = 0; local < 3; local++)
+                extent[axis] += std::fabs(model[local][axis]) * localExtent[local];
+        }
+        centerX[index] = center.x; centerY[index] = center.y; centerZ[index] = center.z;
+        extentX[index] = extent.x; extentY[index] = extent.y; extentZ[index] = extent.z;
+    }
+    // visible[i] = 1 when box i intersects the frustum; visible must hold centerX.size() entries
+    // ------------------------------------------------------------------------
+    void cull(const Frustum& frustum, unsigned char* visible) const
+    {
+        cull(frustum, visible, 0, centerX.size());
+    }
+    // the same for boxes [begin, end) only, so disjoint ranges can be culled on different threads;
+    // begin must be a multiple of 4 and end either one too or centerX.size()
+    // ------------------------------------------------------------------------
+    void cull(const Frustum& frustum, unsigned char* visible, size_t begin, size_t end) const
+    {
+#ifdef FRUSTUM_USE_SSE
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        for (size_t i = begin; i < end; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4& plane = frustum.planes[p];
+                __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+                // signed distance of the center plus the box's projected radius onto the normal
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                             _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                                                      _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+                                           _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+            int mask = _mm_movemask_ps(outside);
+            visible[i] = !(mask & 1);
+            visible[i + 1] = !(mask & 2);
+            visible[i + 2] = !(mask & 4);
+            visible[i + 3] = !(mask & 8);
+        }
+#else
+        for (size_t i = begin; i < end; i++)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+                float radius = std::fabs(plane.x) * extentX[i] + std::fabs(plane.y) * extentY[i] + std::fabs(plane.z) * extentZ[i];
+                inside = distance + radius >= 0.0f;
+            }
+            visible[i] = inside ? 1 : 0;
+        }
+#endif
+    }
+};
+
+#endif
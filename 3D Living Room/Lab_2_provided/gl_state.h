@@ -0,0 +1,355 @@
+//
+//  gl_state.h
+//  3D Object Drawing
+//
+//  Thin shadow of the GL state the renderer touches every frame: bound
+//  program, VAO and buffers, depth/blend switches and functions, and the
+//  last value written to every uniform of every program. A call that would
+//  set what is already set never reaches the driver. Each kind of call is
+//  counted as issued or skipped per frame, so API overhead can be read off
+//  directly; --no-state-cache passes everything through but still counts.
+//
+//  All GL state changes of these kinds must go through here, otherwise the
+//  shadow goes stale. GL_ELEMENT_ARRAY_BUFFER is VAO state and is therefore
+//  always passed through.
+//
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+class GLState
+{
+public:
+    enum CallKind
+    {
+        CALL_PROGRAM,
+        CALL_VAO,
+        CALL_BUFFER,
+        CALL_FIXED_FUNCTION,    // enable/disable, depth and blend functions
+        CALL_UNIFORM,
+        CALL_KIND_COUNT
+    };
+
+    struct Counters
+    {
+        unsigned long long issued[CALL_KIND_COUNT];
+        unsigned long long skipped[CALL_KIND_COUNT];
+        Counters()
+        {
+            memset(issued, 0, sizeof(issued));
+            memset(skipped, 0, sizeof(skipped));
+        }
+    };
+
+    bool enabled;           // false: every call goes to the driver (counted all the same)
+    Counters frame;         // calls since beginFrame()
+    Counters lastFrame;     // the previous complete frame
+    Counters total;         // every completed frame
+    unsigned long long frames;
+
+    static GLState& instance()
+    {
+        static GLState state;
+        return state;
+    }
+    // close the running frame's counters and start new ones
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        lastFrame = frame;
+        for (int k = 0; k < CALL_KIND_COUNT; k++)
+        {
+            total.issued[k] += frame.issued[k];
+            total.skipped[k] += frame.skipped[k];
+        }
+        frame = Counters();
+        frames++;
+    }
+    // forget everything shadowed, e.g. after code that bypassed this class
+    // ------------------------------------------------------------------------
+    void invalidate()
+    {
+        program = vao = UNKNOWN;
+        for (int i = 0; i < BUFFER_TARGET_COUNT; i++)
+            buffers[i] = UNKNOWN;
+        for (int i = 0; i < CAPABILITY_COUNT; i++)
+            capabilities[i] = -1;
+        depthFunc = blendSource = blendDestination = UNKNOWN;
+        uniformValues.clear();
+        lastUniformProgram = UNKNOWN;
+    }
+
+    // ------------------------------------------------------------------------
+    void useProgram(GLuint id)
+    {
+        if (skip(CALL_PROGRAM, program == id))
+            return;
+        glUseProgram(id);
+        program = id;
+    }
+    // ------------------------------------------------------------------------
+    void bindVertexArray(GLuint id)
+    {
+        if (skip(CALL_VAO, vao == id))
+            return;
+        glBindVertexArray(id);
+        vao = id;
+    }
+    // ------------------------------------------------------------------------
+    void bindBuffer(GLenum target, GLuint id)
+    {
+        int slot = bufferSlot(target);
+        if (skip(CALL_BUFFER, slot != -1 && buffers[slot] == id))
+            return;
+        glBindBuffer(target, id);
+        if (slot != -1)
+            buffers[slot] = id;
+    }
+    // also sets the generic binding of target, like the GL call itself
+    // ------------------------------------------------------------------------
+    void bindBufferBase(GLenum target, GLuint index, GLuint id)
+    {
+        count(CALL_BUFFER, true);
+        glBindBufferBase(target, index, id);
+        int slot = bufferSlot(target);
+        if (slot != -1)
+            buffers[slot] = id;
+    }
+    // ------------------------------------------------------------------------
+    void bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+    {
+        count(CALL_BUFFER, true);
+        glBindBufferRange(target, index, id, offset, size);
+        int slot = bufferSlot(target);
+        if (slot != -1)
+            buffers[slot] = id;
+    }
+    // ------------------------------------------------------------------------
+    void enable(GLenum capability)
+    {
+        setCapability(capability, true);
+    }
+    // ------------------------------------------------------------------------
+    void disable(GLenum capability)
+    {
+        setCapability(capability, false);
+    }
+    // ------------------------------------------------------------------------
+    void setDepthFunc(GLenum func)
+    {
+        if (skip(CALL_FIXED_FUNCTION, depthFunc == func))
+            return;
+        glDepthFunc(func);
+        depthFunc = func;
+    }
+    // ------------------------------------------------------------------------
+    void setBlendFunc(GLenum source, GLenum destination)
+    {
+        if (skip(CALL_FIXED_FUNCTION, blendSource == source && blendDestination == destination))
+            return;
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+    }
+
+    // uniforms of program, which must be the bound program; location -1 is dropped like GL does
+    // ------------------------------------------------------------------------
+    void uniform1i(GLuint prog, GLint location, int value)
+    {
+        if (uniformChanged(prog, location, &value, sizeof(value)))
+            glUniform1i(location, value);
+    }
+    void uniform1f(GLuint prog, GLint location, float value)
+    {
+        if (uniformChanged(prog, location, &value, sizeof(value)))
+            glUniform1f(location, value);
+    }
+    void uniform2fv(GLuint prog, GLint location, const float* value)
+    {
+        if (uniformChanged(prog, location, value, 2 * sizeof(float)))
+            glUniform2fv(location, 1, value);
+    }
+    void uniform3fv(GLuint prog, GLint location, const float* value)
+    {
+        if (uniformChanged(prog, location, value, 3 * sizeof(float)))
+            glUniform3fv(location, 1, value);
+    }
+    void uniform4fv(GLuint prog, GLint location, const float* value)
+    {
+        if (uniformChanged(prog, location, value, 4 * sizeof(float)))
+            glUniform4fv(location, 1, value);
+    }
+    void uniformMatrix2fv(GLuint prog, GLint location, const float* value)
+    {
+        if (uniformChanged(prog, location, value, 4 * sizeof(float)))
+            glUniformMatrix2fv(location, 1, GL_FALSE, value);
+    }
+    void uniformMatrix3fv(GLuint prog, GLint location, const float* value)
+    {
+        if (uniformChanged(prog, location, value, 9 * sizeof(float)))
+            glUniformMatrix3fv(location, 1, GL_FALSE, value);
+    }
+    void uniformMatrix4fv(GLuint prog, GLint location, const float* value)
+    {
+        if (uniformChanged(prog, location, value, 16 * sizeof(float)))
+            glUniformMatrix4fv(location, 1, GL_FALSE, value);
+    }
+
+    // deleting through here keeps the shadow from pointing at dead (and possibly reused) names
+    // ------------------------------------------------------------------------
+    void deleteProgram(GLuint id)
+    {
+        glDeleteProgram(id);
+        // a deleted program stays in use until something else is bound
+        uniformValues.erase(id);
+        lastUniformProgram = UNKNOWN;
+    }
+    void deleteVertexArray(GLuint id)
+    {
+        glDeleteVertexArrays(1, &id);
+        if (vao == id)
+            vao = 0;
+    }
+    void deleteBuffer(GLuint id)
+    {
+        glDeleteBuffers(1, &id);
+        for (int i = 0; i < BUFFER_TARGET_COUNT; i++)
+        {
+            if (buffers[i] == id)
+                buffers[i] = 0;
+        }
+    }
+    // ------------------------------------------------------------------------
+    static const char* kindName(int kind)
+    {
+        static const char* names[CALL_KIND_COUNT] = { "program", "VAO", "buffer", "fixed function", "uniform" };
+        return names[kind];
+    }
+    // per-frame averages over every completed frame
+    // ------------------------------------------------------------------------
+    void report() const
+    {
+        if (frames < 2)
+            return;
+        // beginFrame() of the first frame closed an empty set of counters
+        double n = (double)(frames - 1);
+        std::cout << "GL calls per frame (issued/skipped" << (enabled ? "" : ", state cache off") << "):";
+        for (int k = 0; k < CALL_KIND_COUNT; k++)
+            std::cout << " " << kindName(k) << " " << total.issued[k] / n << "/" << total.skipped[k] / n;
+        std::cout << std::endl;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+    enum { BUFFER_TARGET_COUNT = 6, CAPABILITY_COUNT = 4, MAX_UNIFORM_BYTES = 64 };
+
+    struct UniformValue
+    {
+        unsigned char size;     // 0 = never set
+        unsigned char bytes[MAX_UNIFORM_BYTES];
+    };
+
+    GLuint program, vao;
+    GLuint buffers[BUFFER_TARGET_COUNT];
+    int capabilities[CAPABILITY_COUNT];         // -1 unknown, 0 off, 1 on
+    GLenum depthFunc, blendSource, blendDestination;
+    // per program, indexed by uniform location
+    std::unordered_map<GLuint, std::vector<UniformValue> > uniformValues;
+    GLuint lastUniformProgram;
+    std::vector<UniformValue>* lastUniformValues;
+
+    GLState() : enabled(true), frames(0), lastUniformValues(NULL)
+    {
+        invalidate();
+    }
+
+    void count(CallKind kind, bool issued)
+    {
+        if (issued)
+            frame.issued[kind]++;
+        else
+            frame.skipped[kind]++;
+    }
+    // true when the call can be dropped because the shadow already holds the requested state
+    bool skip(CallKind kind, bool redundant)
+    {
+        bool dropped = redundant && enabled;
+        count(kind, !dropped);
+        return dropped;
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:           return 0;
+        case GL_UNIFORM_BUFFER:         return 1;
+        case GL_DRAW_INDIRECT_BUFFER:   return 2;
+        case GL_SHADER_STORAGE_BUFFER:  return 3;
+        case GL_COPY_READ_BUFFER:       return 4;
+        case GL_COPY_WRITE_BUFFER:      return 5;
+        default:                        return -1;  // GL_ELEMENT_ARRAY_BUFFER and anything not tracked
+        }
+    }
+
+    static int capabilitySlot(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_DEPTH_TEST:     return 0;
+        case GL_BLEND:          return 1;
+        case GL_CULL_FACE:      return 2;
+        case GL_SCISSOR_TEST:   return 3;
+        default:                return -1;
+        }
+    }
+
+    void setCapability(GLenum capability, bool on)
+    {
+        int slot = capabilitySlot(capability);
+        if (skip(CALL_FIXED_FUNCTION, slot != -1 && capabilities[slot] == (on ? 1 : 0)))
+            return;
+        if (on)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        if (slot != -1)
+            capabilities[slot] = on ? 1 : 0;
+    }
+
+    bool uniformChanged(GLuint prog, GLint location, const void* value, size_t size)
+    {
+        if (location < 0)
+        {
+            count(CALL_UNIFORM, false);
+            return false;
+        }
+        if (prog != lastUniformProgram)
+        {
+            lastUniformValues = &uniformValues[prog];
+            lastUniformProgram = prog;
+        }
+        std::vector<UniformValue>& values = *lastUniformValues;
+        if ((size_t)location >= values.size())
+        {
+            UniformValue unset;
+            unset.size = 0;
+            values.resize(location + 1, unset);
+        }
+        UniformValue& shadow = values[location];
+        if (skip(CALL_UNIFORM, shadow.size == size && memcmp(shadow.bytes, value, size) == 0))
+            return false;
+        shadow.size = (unsigned char)size;
+        memcpy(shadow.bytes, value, size);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,252 @@
+//
+//  headless.h
+//  3D Object Drawing
+//
+//  Window-less rendering for machines without a display or GPU: an EGL
+//  context (surfaceless when Mesa offers it, pbuffer otherwise; llvmpipe on
+//  CPU-only hosts) and an offscreen framebuffer the scene is rendered into.
+//
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <iostream>
+
+class HeadlessContext
+{
+public:
+#if defined(__linux__)
+    HeadlessContext() : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), surface(EGL_NO_SURFACE), config(NULL),
+                        sharedContext(EGL_NO_CONTEXT), sharedSurface(EGL_NO_SURFACE) {}
+
+    // create a GL 3.3 core context and load the GL functions through glad
+    // ------------------------------------------------------------------------
+    bool create(int width, int height, bool forceSoftware)
+    {
+        // Mesa picks llvmpipe when asked, even on hosts that do have a GPU
+        if (forceSoftware)
+            setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            std::cout << "Failed to initialize EGL" << std::endl;
+            return false;
+        }
+
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_NONE
+        };
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+        {
+            std::cout << "Failed to find an EGL config" << std::endl;
+            return false;
+        }
+
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cout << "Failed to create EGL context" << std::endl;
+            return false;
+        }
+
+        // we always render into our own FBO, so a surface is only needed where surfaceless contexts are missing
+        const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+        bool surfaceless = extensions && strstr(extensions, "EGL_KHR_surfaceless_context");
+        if (!surfaceless)
+        {
+            const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+            surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+        }
+        if (!eglMakeCurrent(display, surface, surface, context))
+        {
+            std::cout << "Failed to make EGL context current" << std::endl;
+            return false;
+        }
+
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+        std::cout << "headless GL: " << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << std::endl;
+        return true;
+    }
+    // a second context sharing objects with the first, for building programs on another thread
+    // ------------------------------------------------------------------------
+    bool createShared()
+    {
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        sharedContext = eglCreateContext(display, config, context, contextAttribs);
+        if (sharedContext == EGL_NO_CONTEXT)
+            return false;
+        // a surface can only be current on one thread, so the second context gets its own
+        if (surface != EGL_NO_SURFACE)
+        {
+            const EGLint surfaceAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            sharedSurface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+        }
+        return true;
+    }
+    // on the thread that uses the shared context
+    // ------------------------------------------------------------------------
+    bool makeSharedCurrent()
+    {
+        return sharedContext != EGL_NO_CONTEXT && eglMakeCurrent(display, sharedSurface, sharedSurface, sharedContext);
+    }
+    void releaseShared()
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (sharedSurface != EGL_NO_SURFACE)
+            eglDestroySurface(display, sharedSurface);
+        if (sharedContext != EGL_NO_CONTEXT)
+            eglDestroyContext(display, sharedContext);
+        if (surface != EGL_NO_SURFACE)
+            eglDestroySurface(display, surface);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+    }
+
+private:
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface;
+    EGLConfig config;
+    EGLContext sharedContext;
+    EGLSurface sharedSurface;
+#else
+    bool create(int, int, bool)
+    {
+        std::cout << "Headless mode needs EGL and is only available on Linux" << std::endl;
+        return false;
+    }
+    bool createShared()
+    {
+        return false;
+    }
+    bool makeSharedCurrent()
+    {
+        return false;
+    }
+    void releaseShared() {}
+    void destroy() {}
+#endif
+};
+
+// color + depth renderbuffers the scene is drawn into instead of a window
+class OffscreenTarget
+{
+public:
+    unsigned int FBO;
+    int width, height;
+
+    OffscreenTarget() : FBO(0), width(0), height(0), colorRBO(0), depthRBO(0) {}
+
+    // ------------------------------------------------------------------------
+    bool create(int w, int h)
+    {
+        width = w;
+        height = h;
+
+        glGenFramebuffers(1, &FBO);
+        glGenRenderbuffers(1, &colorRBO);
+        glGenRenderbuffers(1, &depthRBO);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::FRAMEBUFFER:: Offscreen framebuffer is not complete" << std::endl;
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        return true;
+    }
+    // write the color buffer as a binary PPM (P6), top row first
+    // ------------------------------------------------------------------------
+    bool writePPM(const char* path) const
+    {
+        std::vector<unsigned char> pixels(width * height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+        FILE* file = fopen(path, "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::OFFSCREEN:: Could not open " << path << " for writing" << std::endl;
+            return false;
+        }
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        // GL rows start at the bottom
+        for (int y = height - 1; y >= 0; y--)
+            fwrite(&pixels[y * width * 3], 1, width * 3, file);
+        fclose(file);
+        return true;
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteRenderbuffers(1, &colorRBO);
+        glDeleteRenderbuffers(1, &depthRBO);
+        FBO = colorRBO = depthRBO = 0;
+    }
+
+private:
+    unsigned int colorRBO, depthRBO;
+};
+
+#endif
@@ -0,0 +1,162 @@
+//
+//  indirect_batch.h
+//  3D Object Drawing
+//
+//  Multi-draw indirect submission: one DrawElementsIndirectCommand per box
+//  in an indirect buffer and the box's model matrix + color in a shader
+//  storage buffer, which vertexShaderIndirect.vs indexes with gl_DrawIDARB.
+//  A whole frame of boxes goes out as a single glMultiDrawElementsIndirect.
+//  Needs GL 4.3 (multi-draw indirect, storage buffers) and
+//  ARB_shader_draw_parameters; check available() before using it. The
+//  records are written straight into a RingBuffer region.
+//
+
+#ifndef INDIRECT_BATCH_H
+#define INDIRECT_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "ring_buffer.h"
+
+#include <vector>
+
+// storage buffer binding of the DrawRecords block in vertexShaderIndirect.vs
+const GLuint DRAW_RECORD_BINDING = 1;
+
+// std430 layout of one DrawRecords entry
+struct DrawRecord
+{
+    glm::mat4 model;
+    glm::vec4 color;
+};
+
+// as defined by the GL spec for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+class IndirectBatch
+{
+public:
+    unsigned int VAO;
+    unsigned int commandBuffer;
+    RingBuffer records;
+
+    IndirectBatch() : VAO(0), commandBuffer(0), indexCount(0), commandCapacity(0), count(0), frame(NULL) {}
+
+    // ------------------------------------------------------------------------
+    static bool available()
+    {
+        return GLAD_GL_VERSION_4_3 && GLAD_GL_ARB_shader_draw_parameters;
+    }
+    // VAO over the shared mesh: position and normal. persistent false always uploads
+    // the records with glBufferSubData
+    // ------------------------------------------------------------------------
+    void init(unsigned int meshVBO, unsigned int meshEBO, GLsizei meshIndexCount, bool persistent)
+    {
+        indexCount = meshIndexCount;
+
+        GLint offsetAlignment = 1;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+        records.init(GL_SHADER_STORAGE_BUFFER, (size_t)offsetAlignment, persistent);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &commandBuffer);
+
+        GLState::instance().bindVertexArray(VAO);
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshEBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(7);
+        GLState::instance().bindVertexArray(0);
+    }
+    // start this frame's records; at most maxCount can be added before draw()
+    // ------------------------------------------------------------------------
+    void begin(size_t maxCount)
+    {
+        count = 0;
+        frame = maxCount > 0 ? (DrawRecord*)records.begin(maxCount * sizeof(DrawRecord)) : NULL;
+    }
+    // ------------------------------------------------------------------------
+    void add(const glm::mat4& model, const glm::vec4& color)
+    {
+        DrawRecord& record = frame[count++];
+        record.model = model;
+        record.color = color;
+    }
+    // drop the frame without drawing it
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        count = 0;
+        frame = NULL;
+    }
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        return count;
+    }
+    // hand this frame's records to the GPU and issue them all with one call; the caller binds the shader
+    // ------------------------------------------------------------------------
+    void draw()
+    {
+        if (count == 0)
+            return;
+
+        // every command draws the whole mesh once, so the command buffer only changes when it has to grow
+        if (count > commandCapacity)
+        {
+            commandCapacity = count * 2;
+            std::vector<DrawElementsIndirectCommand> commands(commandCapacity);
+            for (size_t i = 0; i < commands.size(); i++)
+            {
+                commands[i].count = (GLuint)indexCount;
+                commands[i].instanceCount = 1;
+                commands[i].firstIndex = 0;
+                commands[i].baseVertex = 0;
+                commands[i].baseInstance = (GLuint)i;
+            }
+            GLState::instance().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+        }
+
+        size_t bytes = count * sizeof(DrawRecord);
+        records.end(bytes);
+        GLState::instance().bindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_RECORD_BINDING, records.buffer, records.offset(), bytes);
+
+        GLState::instance().bindVertexArray(VAO);
+        GLState::instance().bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)count, 0);
+        records.fence();
+
+        clear();
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        GLState::instance().deleteVertexArray(VAO);
+        GLState::instance().deleteBuffer(commandBuffer);
+        records.destroy();
+        VAO = 0;
+        commandBuffer = 0;
+        commandCapacity = 0;
+        clear();
+    }
+
+private:
+    GLsizei indexCount;
+    size_t commandCapacity;
+    size_t count;
+    DrawRecord* frame;      // this frame's region of the ring
+};
+
+#endif
@@ -0,0 +1,235 @@
+//
+//  input_recorder.h
+//  3D Object Drawing
+//
+//  Per-frame input snapshots (held keys, scroll and mouse deltas, and the
+//  frame time the session ran with) that can be written to a compact binary
+//  file and played back later, so performance runs see exactly the same
+//  camera path. A replay advances by the recorded frame times, which gives
+//  the same simulation ticks as the recorded session; it can also ignore
+//  them and step every frame by the header's fixed delta time.
+//
+//  File layout (little endian):
+//    header: "LRIN", uint32 version, float fixed delta time, uint32 frame count
+//    frame:  uint32 key mask, uint8 flags, float frame time, [float scroll] [float dx, float dy]
+//  the optional floats are only present when the matching flag bit is set.
+//  Version 1 files have no frame time and always replay with the fixed step.
+//
+
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include <GLFW/glfw3.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// keys the scene reacts to; bit i of InputFrame::keys is RECORDED_KEYS[i]
+static const int RECORDED_KEYS[] = {
+    GLFW_KEY_ESCAPE, GLFW_KEY_0, GLFW_KEY_B, GLFW_KEY_W, GLFW_KEY_S,
+    GLFW_KEY_I, GLFW_KEY_K, GLFW_KEY_L, GLFW_KEY_J, GLFW_KEY_O, GLFW_KEY_P,
+    GLFW_KEY_C, GLFW_KEY_V, GLFW_KEY_N, GLFW_KEY_M, GLFW_KEY_U,
+    GLFW_KEY_X, GLFW_KEY_Y, GLFW_KEY_Z,
+    GLFW_KEY_H, GLFW_KEY_F, GLFW_KEY_T, GLFW_KEY_G, GLFW_KEY_Q, GLFW_KEY_E,
+    GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4
+};
+static const int RECORDED_KEY_COUNT = sizeof(RECORDED_KEYS) / sizeof(RECORDED_KEYS[0]);
+
+struct InputFrame
+{
+    unsigned int keys;      // one bit per RECORDED_KEYS entry
+    float scrollY;          // for BasicCamera::ProcessMouseScroll
+    float mouseDX, mouseDY; // for BasicCamera::ProcessMouseMovement
+    float deltaTime;        // seconds since the previous frame
+
+    InputFrame() : keys(0), scrollY(0.0f), mouseDX(0.0f), mouseDY(0.0f), deltaTime(0.0f) {}
+
+    bool isDown(int glfwKey) const
+    {
+        for (int i = 0; i < RECORDED_KEY_COUNT; i++)
+        {
+            if (RECORDED_KEYS[i] == glfwKey)
+                return (keys >> i) & 1u;
+        }
+        return false;
+    }
+};
+
+const unsigned int INPUT_FILE_VERSION = 2;
+const unsigned int INPUT_FILE_VERSION_FIXED_STEP = 1;     // no per-frame times
+const unsigned char INPUT_HAS_SCROLL = 1;
+const unsigned char INPUT_HAS_MOUSE = 2;
+
+class InputRecorder
+{
+public:
+    InputRecorder() : active(false), fixedDeltaTime(1.0f / 60.0f) {}
+
+    // frames are kept in memory and written once by finish()
+    // ------------------------------------------------------------------------
+    void start(const char* filePath, float fixedStep)
+    {
+        path = filePath;
+        fixedDeltaTime = fixedStep;
+        frames.clear();
+        active = true;
+    }
+    // ------------------------------------------------------------------------
+    bool isActive() const
+    {
+        return active;
+    }
+    // ------------------------------------------------------------------------
+    void record(const InputFrame& frame)
+    {
+        if (active)
+            frames.push_back(frame);
+    }
+    // ------------------------------------------------------------------------
+    bool finish()
+    {
+        if (!active)
+            return false;
+        active = false;
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::INPUT:: Could not open " << path << " for writing" << std::endl;
+            return false;
+        }
+        unsigned int count = (unsigned int)frames.size();
+        fwrite("LRIN", 1, 4, file);
+        fwrite(&INPUT_FILE_VERSION, sizeof(unsigned int), 1, file);
+        fwrite(&fixedDeltaTime, sizeof(float), 1, file);
+        fwrite(&count, sizeof(unsigned int), 1, file);
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            const InputFrame& frame = frames[i];
+            unsigned char flags = 0;
+            if (frame.scrollY != 0.0f)
+                flags |= INPUT_HAS_SCROLL;
+            if (frame.mouseDX != 0.0f || frame.mouseDY != 0.0f)
+                flags |= INPUT_HAS_MOUSE;
+
+            fwrite(&frame.keys, sizeof(unsigned int), 1, file);
+            fwrite(&flags, 1, 1, file);
+            fwrite(&frame.deltaTime, sizeof(float), 1, file);
+            if (flags & INPUT_HAS_SCROLL)
+                fwrite(&frame.scrollY, sizeof(float), 1, file);
+            if (flags & INPUT_HAS_MOUSE)
+            {
+                fwrite(&frame.mouseDX, sizeof(float), 1, file);
+                fwrite(&frame.mouseDY, sizeof(float), 1, file);
+            }
+        }
+        fclose(file);
+        std::cout << "recorded " << count << " input frames to " << path << std::endl;
+        return true;
+    }
+
+private:
+    bool active;
+    float fixedDeltaTime;
+    std::string path;
+    std::vector<InputFrame> frames;
+};
+
+class InputReplay
+{
+public:
+    float fixedDeltaTime;
+    bool fixedStep;         // ignore recorded frame times and advance every frame by fixedDeltaTime
+
+    InputReplay() : fixedDeltaTime(1.0f / 60.0f), fixedStep(false), cursor(0), active(false), frameTimes(false) {}
+
+    // ------------------------------------------------------------------------
+    bool load(const char* path)
+    {
+        FILE* file = fopen(path, "rb");
+        if (!file)
+        {
+            std::cout << "ERROR::INPUT:: Could not open " << path << std::endl;
+            return false;
+        }
+
+        char magic[4];
+        unsigned int version = 0, count = 0;
+        bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, "LRIN", 4) == 0
+            && fread(&version, sizeof(unsigned int), 1, file) == 1
+            && (version == INPUT_FILE_VERSION || version == INPUT_FILE_VERSION_FIXED_STEP)
+            && fread(&fixedDeltaTime, sizeof(float), 1, file) == 1
+            && fread(&count, sizeof(unsigned int), 1, file) == 1;
+
+        frames.clear();
+        for (unsigned int i = 0; ok && i < count; i++)
+        {
+            InputFrame frame;
+            unsigned char flags = 0;
+            ok = fread(&frame.keys, sizeof(unsigned int), 1, file) == 1 && fread(&flags, 1, 1, file) == 1;
+            if (ok && version == INPUT_FILE_VERSION)
+                ok = fread(&frame.deltaTime, sizeof(float), 1, file) == 1 && frame.deltaTime >= 0.0f;
+            if (ok && (flags & INPUT_HAS_SCROLL))
+                ok = fread(&frame.scrollY, sizeof(float), 1, file) == 1;
+            if (ok && (flags & INPUT_HAS_MOUSE))
+                ok = fread(&frame.mouseDX, sizeof(float), 1, file) == 1 && fread(&frame.mouseDY, sizeof(float), 1, file) == 1;
+            frames.push_back(frame);
+        }
+        fclose(file);
+
+        if (!ok)
+        {
+            std::cout << "ERROR::INPUT:: " << path << " is not a valid input recording" << std::endl;
+            frames.clear();
+            return false;
+        }
+        cursor = 0;
+        active = true;
+        frameTimes = version == INPUT_FILE_VERSION;
+        return true;
+    }
+    // ------------------------------------------------------------------------
+    bool isActive() const
+    {
+        return active;
+    }
+    // ------------------------------------------------------------------------
+    size_t frameCount() const
+    {
+        return frames.size();
+    }
+    // true when frames advance by their recorded times rather than by fixedDeltaTime
+    // ------------------------------------------------------------------------
+    bool usesFrameTimes() const
+    {
+        return frameTimes && !fixedStep;
+    }
+    // time step of the frame next() hands out
+    // ------------------------------------------------------------------------
+    float nextDeltaTime() const
+    {
+        if (!usesFrameTimes() || cursor >= frames.size())
+            return fixedDeltaTime;
+        return frames[cursor].deltaTime;
+    }
+    // hand out the next recorded frame; false once the recording is exhausted
+    // ------------------------------------------------------------------------
+    bool next(InputFrame& frame)
+    {
+        if (cursor >= frames.size())
+            return false;
+        frame = frames[cursor++];
+        return true;
+    }
+
+private:
+    std::vector<InputFrame> frames;
+    size_t cursor;
+    bool active;
+    bool frameTimes;        // the file has per-frame times (version 2)
+};
+
+#endif
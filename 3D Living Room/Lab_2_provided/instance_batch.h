@@ -0,0 +1,132 @@
+//
+//  instance_batch.h
+//  3D Object Drawing
+//
+//  Collects every cube drawn in a frame (model matrix + color) into one
+//  per-instance buffer so the whole set goes out as a single
+//  glDrawElementsInstanced call. The instances are written straight into
+//  a RingBuffer region (see ring_buffer.h).
+//
+
+#ifndef INSTANCE_BATCH_H
+#define INSTANCE_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "ring_buffer.h"
+
+// per-instance data as laid out in the instance buffer (locations 2..6 in vertexShaderInstanced.vs)
+struct CubeInstance
+{
+    glm::mat4 model;
+    glm::vec4 color;
+};
+
+class InstanceBatch
+{
+public:
+    unsigned int VAO;
+    RingBuffer instances;
+
+    InstanceBatch() : VAO(0), indexCount(0), count(0), frame(NULL), attributeBuffer(0) {}
+
+    // build a VAO that reads the mesh from meshVBO/meshEBO; the instance attributes are pointed at
+    // the ring by draw(); persistent false always uploads with glBufferSubData
+    // ------------------------------------------------------------------------
+    void init(unsigned int meshVBO, unsigned int meshEBO, GLsizei meshIndexCount, bool persistent)
+    {
+        indexCount = meshIndexCount;
+        instances.init(GL_ARRAY_BUFFER, sizeof(CubeInstance), persistent);
+
+        glGenVertexArrays(1, &VAO);
+
+        GLState::instance().bindVertexArray(VAO);
+
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshEBO);
+
+        // position and normal attributes
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(7);
+
+        // model matrix, one vec4 column per attribute location, then the instance color
+        for (unsigned int i = 0; i < 5; i++)
+        {
+            glEnableVertexAttribArray(2 + i);
+            glVertexAttribDivisor(2 + i, 1);
+        }
+
+        GLState::instance().bindVertexArray(0);
+    }
+    // start this frame's instances; at most maxCount can be added before draw()
+    // ------------------------------------------------------------------------
+    void begin(size_t maxCount)
+    {
+        count = 0;
+        frame = maxCount > 0 ? (CubeInstance*)instances.begin(maxCount * sizeof(CubeInstance)) : NULL;
+    }
+    // ------------------------------------------------------------------------
+    void add(const glm::mat4& model, const glm::vec4& color)
+    {
+        CubeInstance& instance = frame[count++];
+        instance.model = model;
+        instance.color = color;
+    }
+    // drop the frame without drawing it
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        count = 0;
+        frame = NULL;
+    }
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        return count;
+    }
+    // hand this frame's instances to the GPU and draw them all with one call; the caller binds the shader
+    // ------------------------------------------------------------------------
+    void draw()
+    {
+        if (count == 0)
+            return;
+
+        instances.end(count * sizeof(CubeInstance));
+
+        GLState::instance().bindVertexArray(VAO);
+        // a persistent ring moves to another region every frame (and to a new buffer when it grows);
+        // the orphaning path always uses the same buffer from offset 0
+        if (instances.isPersistent() || instances.buffer != attributeBuffer)
+        {
+            attributeBuffer = instances.buffer;
+            GLState::instance().bindBuffer(GL_ARRAY_BUFFER, attributeBuffer);
+            for (unsigned int i = 0; i < 5; i++)
+                glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(instances.offset() + i * sizeof(glm::vec4)));
+        }
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, (GLsizei)count);
+        instances.fence();
+
+        clear();
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        GLState::instance().deleteVertexArray(VAO);
+        instances.destroy();
+        VAO = 0;
+        attributeBuffer = 0;
+        clear();
+    }
+
+private:
+    GLsizei indexCount;
+    size_t count;
+    CubeInstance* frame;            // this frame's region of the ring
+    unsigned int attributeBuffer;   // buffer the VAO's instance attributes currently point at
+};
+
+#endif
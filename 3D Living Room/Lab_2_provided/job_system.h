@@ -0,0 +1,199 @@
+//
+//  job_system.h
+//  3D Object Drawing
+//
+//  Work-stealing job system. Every thread (the main thread is thread 0) owns
+//  a job queue: it pushes and pops at the back, idle threads steal from the
+//  front of someone else's queue. Jobs signal a Counter when they finish;
+//  wait() keeps running jobs until the counter drops to zero, so waiting
+//  threads help instead of blocking.
+//
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+public:
+    // jobs still outstanding in one batch
+    struct Counter
+    {
+        std::atomic<int> pending;
+        Counter() : pending(0) {}
+    };
+
+    typedef std::function<void()> Job;
+
+    JobSystem() : running(false), queued(0) {}
+    ~JobSystem()
+    {
+        stop();
+    }
+
+    // workers in addition to the main thread; 0 picks one less than the hardware threads
+    // ------------------------------------------------------------------------
+    void start(unsigned int workerCount = 0)
+    {
+        if (running)
+            return;
+        if (workerCount == 0)
+        {
+            unsigned int hardware = std::thread::hardware_concurrency();
+            workerCount = hardware > 1 ? hardware - 1 : 0;
+        }
+        queues.clear();
+        for (unsigned int i = 0; i < workerCount + 1; i++)
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+        threadIndex() = 0;
+        running = true;
+        for (unsigned int i = 0; i < workerCount; i++)
+            workers.push_back(std::thread(&JobSystem::workerLoop, this, (int)i + 1));
+    }
+    // ------------------------------------------------------------------------
+    void stop()
+    {
+        if (!running)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+        queues.clear();
+    }
+    // threads that execute jobs, the main thread included
+    // ------------------------------------------------------------------------
+    unsigned int threadCount() const
+    {
+        return (unsigned int)workers.size() + 1;
+    }
+    // index of the calling thread, 0 for the main thread
+    // ------------------------------------------------------------------------
+    static int& threadIndex()
+    {
+        static thread_local int index = 0;
+        return index;
+    }
+    // queue a job on the calling thread's queue; counter is decremented when it has run
+    // ------------------------------------------------------------------------
+    void run(Counter& counter, Job job)
+    {
+        counter.pending++;
+        if (!running)
+        {
+            job();
+            counter.pending--;
+            return;
+        }
+        Queue& queue = *queues[threadIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(Entry(job, &counter));
+        }
+        queued++;
+        {
+            // pairs with the predicate check in workerLoop so a worker about to sleep cannot miss this job
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+    // run jobs (own first, then stolen) until every job of counter has finished
+    // ------------------------------------------------------------------------
+    void wait(Counter& counter)
+    {
+        while (counter.pending > 0)
+        {
+            if (!runOne(threadIndex()))
+                std::this_thread::yield();
+        }
+    }
+    // body(index, thread) for every index in [0, count) as individual jobs; returns when all are done
+    // ------------------------------------------------------------------------
+    void parallelFor(int count, const std::function<void(int, int)>& body)
+    {
+        if (count <= 0)
+            return;
+        if (!running || workers.empty() || count == 1)
+        {
+            for (int i = 0; i < count; i++)
+                body(i, threadIndex());
+            return;
+        }
+        Counter counter;
+        for (int i = 0; i < count; i++)
+            run(counter, [&body, i] { body(i, JobSystem::threadIndex()); });
+        wait(counter);
+    }
+
+private:
+    struct Entry
+    {
+        Job job;
+        Counter* counter;
+        Entry(const Job& j, Counter* c) : job(j), counter(c) {}
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Entry> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue> > queues;    // one per thread, index = threadIndex()
+    std::vector<std::thread> workers;
+    std::atomic<bool> running;
+    std::atomic<int> queued;                        // jobs sitting in any queue
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    // newest job of our own queue, or the oldest of another thread's queue
+    bool runOne(int self)
+    {
+        int count = (int)queues.size();
+        for (int attempt = 0; attempt < count; attempt++)
+        {
+            int victim = (self + attempt) % count;
+            Queue& queue = *queues[victim];
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            Entry entry = attempt == 0 ? queue.jobs.back() : queue.jobs.front();
+            if (attempt == 0)
+                queue.jobs.pop_back();
+            else
+                queue.jobs.pop_front();
+            lock.unlock();
+
+            queued--;
+            entry.job();
+            entry.counter->pending--;
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(int index)
+    {
+        threadIndex() = index;
+        while (running)
+        {
+            if (runOne(index))
+                continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return !running || queued > 0; });
+        }
+    }
+};
+
+#endif
@@ -13,33 +13,73 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "gl_state.h"
 #include "shader.h"
+#include "shader_watcher.h"
 #include "basic_camera.h"
+#include "frame_uniforms.h"
+#include "instance_batch.h"
+#include "indirect_batch.h"
+#include "static_batch.h"
+#include "draw_queue.h"
+#include "mesh_asset.h"
+#include "headless.h"
+#include "input_recorder.h"
+#include "job_system.h"
+#include "software_rasterizer.h"
+#include "frustum.h"
+#include "occlusion.h"
+#include "clustered_lights.h"
+#include "bvh.h"
+#include "profiler.h"
+#include "scene_graph.h"
+#include "scene_file.h"
+#include "room_builder.h"
+#include "memory_usage.h"
 
 #include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <memory>
 
 using namespace std;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow* window);
-void drawTableChair(unsigned int VAO, Shader ourShader);
-void drawFan(unsigned int VAO, Shader ourShader);
-
-glm::mat4 createRotateYMatrix(float angle) {
-    glm::mat4 rotateYMatrix(1.0f);
-    float radians = glm::radians(angle);
-    rotateYMatrix[0][0] = cos(radians);
-    rotateYMatrix[0][2] = sin(radians);
-    rotateYMatrix[2][0] = -sin(radians);
-    rotateYMatrix[2][2] = cos(radians);
-    return rotateYMatrix;
-}
+void processInput(const InputFrame& input);
+void simulate(const InputFrame& input, float dt);
+InputFrame sampleInput(GLFWwindow* window);
+void printFrameStats(std::vector<double> frameTimes);
+void printUsage(const char* program);
+struct SimulationState;
+SimulationState captureState();
+float advanceClock(int frameCount, bool wallClock);
+void stepSimulation(const InputFrame& input);
+SimulationState interpolatedState();
+void cameraMatrices(glm::mat4& projection, glm::mat4& view, glm::vec3& cameraPosition, const SimulationState& state);
+int runSoftwareRenderer();
+void drawScene(unsigned int VAO, const Shader& ourShader, const SceneGraph& scene, const glm::vec3& eye);
+void syncStaticBatch(const SceneGraph& scene);
+void syncBounds(const SceneGraph& scene);
+void cullScene(const SceneGraph& scene, const glm::mat4& viewProjection);
+bool isOccluder(const glm::vec3& boxScale);
+void localBounds(const SceneGraph& scene, int node, glm::vec3& boundsMin, glm::vec3& boundsMax);
+int pickObject(const SceneGraph& scene, double cursorX, double cursorY, const glm::mat4& viewProjection, const glm::vec3& eye);
+int resolveMesh(const StringView& path);
+bool buildScene(bool sceneFileLoaded = false);
+void placeLights(const SceneGraph& scene);
+void reloadScene();
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const float NEAR_PLANE = 0.1f, FAR_PLANE = 100.0f;
 
 // modelling transform
 float rotateAngle_X = 0.0;
@@ -69,7 +109,8 @@ BasicCamera basic_camera(eyeX, eyeY, eyeZ, lookAtX, lookAtY, lookAtZ, V);
 float deltaTime = 0.0f;    // time between current frame and last frame
 float lastFrame = 0.0f;
 
-float r = 0.0f;
+float r = 0.0f;                 // fan angle in degrees
+const float FAN_SPEED = 30.0f;  // degrees per second
 bool fanOn = false;
 
 bool birdEyeView = false;
@@ -77,227 +118,762 @@ glm::vec3 birdEyePosition(1.0f, 2.5f, 3.0f); // Initial position (10 units above
 glm::vec3 birdEyeTarget(1.0f, 0.0f, 0.0f);   // Focus point
 float birdEyeSpeed = 1.0f;
 
-int main()
-{
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+// fixed-rate simulation (--sim-hz): held keys and the fan advance in ticks of simulationStep whatever the
+// frame rate, and each frame renders the state interpolated between the last two ticks
+float simulationStep = 1.0f / 60.0f;
+float simulationAccumulator = 0.0f;
+const float MAX_FRAME_TIME = 0.25f;     // a stalled frame owes at most this much simulated time
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+struct SimulationState
+{
+    glm::vec3 eye, lookAt;
+    glm::vec3 birdEyePosition, birdEyeTarget;
+    float fanAngle;
+};
+SimulationState previousState, currentState;
+
+// instanced rendering: cubes are queued in cubeBatch and drawn with one call per frame
+bool instancedRendering = true;
+InstanceBatch cubeBatch;
+
+// --multi-draw-indirect: every box of the room (nothing baked or instanced) goes out in one
+// glMultiDrawElementsIndirect; without GL 4.3 + ARB_shader_draw_parameters it falls back to one draw per box
+bool multiDrawIndirect = false;
+IndirectBatch indirectBatch;
+
+// the instance and indirect batches write their per-frame data into persistently mapped ring buffers
+// where GL 4.4 / ARB_buffer_storage allows it; --no-persistent-map always orphans and uses glBufferSubData
+bool persistentMapping = true;
+
+// the room as a scene graph; fanHubs are the nodes the fan blades spin with
+SceneGraph scene;
+std::vector<int> fanHubs;
+
+// the room is read from a scene file (scene_file.h), text or binary; when the default file is missing it is
+// built by room_builder.h. scene[0 .. sceneFileNodes) came from the file and follows its edits while running.
+const char* scenePath = "living_room.scene";
+bool scenePathGiven = false;
+const char* sceneOutput = NULL;         // --write-scene: save the room (.scene or .sceneb) and exit
+SceneFile sceneFile;
+size_t sceneFileNodes = 0;
+float lastSceneCheck = 0.0f;
+const float SCENE_CHECK_INTERVAL = 0.25f;
+
+// --rooms rows columns [--seed n]: a generated grid of randomized rooms (room_builder.h) in place of the scene
+// file, for measuring how frame time and memory scale with the object count
+int roomRows = 0;
+int roomColumns = 0;
+uint32_t roomSeed = 1;
+
+// .mesh files (tools/obj2mesh) placed in the room with --mesh file x y z; scene.mesh indexes meshes
+struct MeshPlacement
+{
+    const char* path;
+    glm::vec3 position;
+};
+std::vector<MeshPlacement> meshPlacements;
+std::vector<MeshAsset> meshes;
+
+// static boxes baked into one buffer; staticSlot maps scene node -> batch slot (-1 if not baked)
+bool staticBaking = true;
+StaticBatch staticBatch;
+std::vector<int> staticSlot;
+
+// headless mode: render a fixed number of frames into an FBO through EGL, no window or input
+bool headlessMode = false;
+bool softwareGL = false;
+int headlessFrames = 300;
+const char* headlessOutput = NULL;
+
+// input recording/replay; the callbacks only accumulate motion, processInput applies it once per frame
+InputRecorder inputRecorder;
+InputReplay inputReplay;
+bool quitRequested = false;
+float pendingScrollY = 0.0f;
+float pendingMouseDX = 0.0f, pendingMouseDY = 0.0f;
+
+// world-space box of every scene node, kept up to date from scene.changed; sceneBVH is built over the drawable ones
+BoxBounds sceneBounds;
+BVH sceneBVH;
+
+// frustum culling: nodeVisible/slotVisible are refreshed every frame from sceneBounds
+bool frustumCulling = true;
+Frustum viewFrustum;
+std::vector<unsigned char> nodeVisible;
+std::vector<unsigned char> slotVisible;
+int visibleBoxes = 0, culledBoxes = 0;
+
+// occlusion culling after the frustum test: the largest visible walls, floors and roofs are rasterized into a
+// low-resolution depth buffer on the CPU and every remaining box is tested against its Hi-Z chain (occlusion.h);
+// --no-occlusion turns it off. occludedBoxes counts the boxes it removed, they are part of culledBoxes.
+bool occlusionCulling = true;
+OcclusionBuffer occlusionBuffer;
+const int OCCLUSION_WIDTH = 256, OCCLUSION_HEIGHT = 192;
+const size_t MAX_OCCLUDERS = 48;
+const float OCCLUDER_MIN_SCALE = 2.0f;      // boxes at least this big along two axes can occlude
+int occludedBoxes = 0;
+std::vector<std::pair<float, int> > occluderCandidates;
+
+// clustered forward lighting (clustered_lights.h): ceiling lights in every room and a lamp over every table,
+// plus --lights n random ones; --no-lighting keeps the flat colors
+bool lighting = true;
+LightClusters lightClusters;
+std::vector<PointLight> pointLights;
+int extraLights = 0;
+const glm::vec3 AMBIENT_LIGHT(0.3f, 0.3f, 0.32f);
+
+// picking: a left click (or --pick x y on the last headless frame) casts a ray from the eye through the cursor
+bool pickRequested = false;
+bool mouseWasDown = false;
+double pickX = 0.0, pickY = 0.0;
+bool headlessPick = false;
+
+// shader hot reload: on by default with a window, --hot-reload turns it on for headless runs too
+bool hotReload = false;
+
+// --renderer software: rasterize on the CPU without any GL context
+bool softwareRenderer = false;
+
+// scene update, bounds, culling, draw-list generation and the software rasterizer run as jobs here;
+// --threads sets the worker count (0 = one per hardware thread besides the main thread)
+JobSystem jobs;
+unsigned int workerThreads = 0;
+const int NODES_PER_JOB = 4096;                     // multiple of 4 for the SSE culling ranges
+std::vector<DrawQueue> rangeQueues;                 // one per node range, filled by drawScene's jobs
+std::vector<int> rangeVisibleBoxes, rangeCulledBoxes, rangeOccludedBoxes;
+std::vector<std::vector<std::pair<float, int> > > rangeOccluders;
+
+// this frame's per-frame draws, merged from rangeQueues and sorted by key
+DrawQueue drawQueue;
+
+// the unit box of every box node, shared by the GL buffers, the static batch and the software renderer:
+// position and outward normal; every face has its own four corners so the normals stay flat
+const float cube_vertices[] = {
+    0.0f, 0.0f, 0.0f,  0.0f, 0.0f, -1.0f,
+    0.5f, 0.0f, 0.0f,  0.0f, 0.0f, -1.0f,
+    0.5f, 0.5f, 0.0f,  0.0f, 0.0f, -1.0f,
+    0.0f, 0.5f, 0.0f,  0.0f, 0.0f, -1.0f,
+
+    0.0f, 0.0f, 0.5f,  0.0f, 0.0f, 1.0f,
+    0.5f, 0.0f, 0.5f,  0.0f, 0.0f, 1.0f,
+    0.5f, 0.5f, 0.5f,  0.0f, 0.0f, 1.0f,
+    0.0f, 0.5f, 0.5f,  0.0f, 0.0f, 1.0f,
+
+    0.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f,
+    0.0f, 0.5f, 0.0f,  -1.0f, 0.0f, 0.0f,
+    0.0f, 0.5f, 0.5f,  -1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 0.5f,  -1.0f, 0.0f, 0.0f,
+
+    0.5f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,
+    0.5f, 0.5f, 0.0f,  1.0f, 0.0f, 0.0f,
+    0.5f, 0.5f, 0.5f,  1.0f, 0.0f, 0.0f,
+    0.5f, 0.0f, 0.5f,  1.0f, 0.0f, 0.0f,
+
+    0.0f, 0.0f, 0.0f,  0.0f, -1.0f, 0.0f,
+    0.5f, 0.0f, 0.0f,  0.0f, -1.0f, 0.0f,
+    0.5f, 0.0f, 0.5f,  0.0f, -1.0f, 0.0f,
+    0.0f, 0.0f, 0.5f,  0.0f, -1.0f, 0.0f,
+
+    0.0f, 0.5f, 0.0f,  0.0f, 1.0f, 0.0f,
+    0.5f, 0.5f, 0.0f,  0.0f, 1.0f, 0.0f,
+    0.5f, 0.5f, 0.5f,  0.0f, 1.0f, 0.0f,
+    0.0f, 0.5f, 0.5f,  0.0f, 1.0f, 0.0f,
+};
+const unsigned int cube_indices[] = {
+    1, 2, 3,
+    3, 0, 1,
+
+    5, 6, 7,
+    7, 4, 5,
+
+    11, 10, 9,
+    9, 8, 11,
+
+    15, 14, 13,
+    13, 12, 15,
+
+    18, 17, 16,
+    16, 19, 18,
+
+    22, 21, 20,
+    20, 23, 22,
+};
+
+// builds with ENABLE_PROFILER write the per-region timings here on exit (.json = Chrome trace, else CSV)
+const char* profileOutput = NULL;
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--no-instancing") == 0)
+            instancedRendering = false;
+        else if (strcmp(argv[i], "--no-static-batch") == 0)
+            staticBaking = false;
+        else if (strcmp(argv[i], "--no-culling") == 0)
+            frustumCulling = false;
+        else if (strcmp(argv[i], "--no-occlusion") == 0)
+            occlusionCulling = false;
+        else if (strcmp(argv[i], "--shader-cache") == 0 && i + 1 < argc)
+            ProgramCache::directory() = argv[++i];
+        else if (strcmp(argv[i], "--no-shader-cache") == 0)
+            ProgramCache::directory().clear();
+        else if (strcmp(argv[i], "--no-state-cache") == 0)
+            GLState::instance().enabled = false;
+        else if (strcmp(argv[i], "--hot-reload") == 0)
+            hotReload = true;
+        else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc)
+        {
+            const char* renderer = argv[++i];
+            if (strcmp(renderer, "software") == 0)
+                softwareRenderer = true;
+            else if (strcmp(renderer, "gl") != 0)
+            {
+                std::cout << "unknown renderer " << renderer << " (expected gl or software)" << std::endl;
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc)
+        {
+            float hz = (float)atof(argv[++i]);
+            if (hz <= 0.0f)
+            {
+                std::cout << "--sim-hz needs a positive rate" << std::endl;
+                return -1;
+            }
+            simulationStep = 1.0f / hz;
+        }
+        else if (strcmp(argv[i], "--multi-draw-indirect") == 0)
+            multiDrawIndirect = true;
+        else if (strcmp(argv[i], "--no-persistent-map") == 0)
+            persistentMapping = false;
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+        {
+            scenePath = argv[++i];
+            scenePathGiven = true;
+        }
+        else if (strcmp(argv[i], "--write-scene") == 0 && i + 1 < argc)
+            sceneOutput = argv[++i];
+        else if (strcmp(argv[i], "--rooms") == 0 && i + 2 < argc)
+        {
+            roomRows = std::max(1, atoi(argv[++i]));
+            roomColumns = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            roomSeed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--no-lighting") == 0)
+            lighting = false;
+        else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            extraLights = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--mesh") == 0 && i + 4 < argc)
+        {
+            MeshPlacement placement;
+            placement.path = argv[++i];
+            placement.position.x = (float)atof(argv[++i]);
+            placement.position.y = (float)atof(argv[++i]);
+            placement.position.z = (float)atof(argv[++i]);
+            meshPlacements.push_back(placement);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            workerThreads = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pick") == 0 && i + 2 < argc)
+        {
+            pickX = atof(argv[++i]);
+            pickY = atof(argv[++i]);
+            headlessPick = true;
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+            headlessMode = true;
+        else if (strcmp(argv[i], "--software-gl") == 0)
+            softwareGL = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            headlessFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            headlessOutput = argv[++i];
+        else if (strcmp(argv[i], "--fan-on") == 0)
+            fanOn = true;
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            inputRecorder.start(argv[++i], 1.0f / 60.0f);
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            if (!inputReplay.load(argv[++i]))
+                return -1;
+        }
+        else if (strcmp(argv[i], "--replay-fixed-step") == 0)
+            inputReplay.fixedStep = true;
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profileOutput = argv[++i];
+#ifndef ENABLE_PROFILER
+            std::cout << "--profile ignored: built without ENABLE_PROFILER" << std::endl;
 #endif
+        }
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+    }
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CSE 4208: Computer Graphics Laboratory", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+    // the CPU backend has no lighting; its images compare against GL runs with --no-lighting
+    if (softwareRenderer)
+        lighting = false;
+
+    if (multiDrawIndirect) {
+        instancedRendering = false;
+        staticBaking = false;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    //glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
 
-    // tell GLFW to capture our mouse
-    // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    previousState = currentState = captureState();
+    jobs.start(workerThreads);
+    if (softwareRenderer)
+        return runSoftwareRenderer();
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    GLFWwindow* window = NULL;
+    HeadlessContext headlessContext;
+    OffscreenTarget offscreenTarget;
+
+    if (headlessMode)
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // EGL context without any window system; glad is loaded inside
+        if (!headlessContext.create(SCR_WIDTH, SCR_HEIGHT, softwareGL))
+            return -1;
+    }
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CSE 4208: Computer Graphics Laboratory", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        //glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        // tell GLFW to capture our mouse
+        // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    GLState::instance().enable(GL_DEPTH_TEST);
+
+    if (multiDrawIndirect && !IndirectBatch::available()) {
+        std::cout << "multi-draw indirect needs GL 4.3 and ARB_shader_draw_parameters, drawing one box at a time" << std::endl;
+        multiDrawIndirect = false;
+    }
 
     // build and compile our shader zprogram
     // ------------------------------------
-    Shader ourShader("vertexShader.vs", "fragmentShader.fs");
+    std::chrono::steady_clock::time_point shaderStart = std::chrono::steady_clock::now();
 
-    Shader constantShader("vertexShader.vs", "fragmentShaderV2.fs");
+    // the lit variants share fragmentShaderLit.fs; VERTEX_COLOR picks the color input of the batched paths
+    const char* uniformColorFragment = lighting ? "fragmentShaderLit.fs" : "fragmentShader.fs";
+    const char* vertexColorFragment = lighting ? "fragmentShaderLit.fs" : "fragmentShaderVertexColor.fs";
+    const char* uniformColorDefines = lighting ? "#define LIGHTING\n" : NULL;
+    const char* vertexColorDefines = lighting ? "#define LIGHTING\n#define VERTEX_COLOR\n" : NULL;
 
-    // set up vertex data (and buffer(s)) and configure vertex attributes
-    // ------------------------------------------------------------------
-    float cube_vertices[] = {
-        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
-        0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
-        0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f,
-        0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f,
-
-        0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f,
-        0.5f, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f,
-        0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 0.0f,
-        0.0f, 0.5f, 0.5f, 0.0f, 0.0f, 0.0f,
+    Shader ourShader("vertexShader.vs", uniformColorFragment, uniformColorDefines);
 
-    };
-    unsigned int cube_indices[] = {
-        1, 2, 3,
-        3, 0, 1,
-
-        5, 6, 7,
-        7, 4, 5,
+    Shader constantShader("vertexShader.vs", "fragmentShaderV2.fs");
 
-        4, 7, 3,
-        3, 0, 4,
+    Shader instancedShader("vertexShaderInstanced.vs", vertexColorFragment, vertexColorDefines);
 
-        5, 6, 2,
-        2, 1, 5,
+    Shader bakedShader("vertexShader.vs", vertexColorFragment, vertexColorDefines);
 
-        5, 1, 0,
-        0, 4, 5,
+    // GLSL 4.30, so only built where the path can run
+    std::unique_ptr<Shader> indirectShader;
+    if (multiDrawIndirect)
+        indirectShader.reset(new Shader("vertexShaderIndirect.vs", vertexColorFragment, vertexColorDefines));
 
-        6, 2, 3,
-        3, 7, 6,
-    };
+    std::cout << "shaders ready in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count()
+              << " ms (" << ProgramCache::hits() << " cached, " << ProgramCache::misses() << " compiled)" << std::endl;
 
+    // set up vertex data (and buffer(s)) and configure vertex attributes
+    // ------------------------------------------------------------------
     unsigned int VBO, VAO, EBO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    GLState::instance().bindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
 
     // position attribute
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    //color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)12);
-    glEnableVertexAttribArray(1);
+    // normal attribute
+    glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)12);
+    glEnableVertexAttribArray(7);
+    // meshes feed their dequantization step here (mesh_asset.h); everything else leaves it at one
+    glVertexAttrib3f(MESH_NORMAL_SCALE_LOCATION, 1.0f, 1.0f, 1.0f);
 
+    cubeBatch.init(VBO, EBO, 36, persistentMapping);
+    if (multiDrawIndirect)
+        indirectBatch.init(VBO, EBO, 36, persistentMapping);
+    staticBatch.init(cube_vertices, cube_indices);
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    if (!buildScene())
+        return -1;
+    if (sceneOutput) {
+        std::vector<std::string> meshPaths;
+        for (size_t i = 0; i < meshes.size(); i++)
+            meshPaths.push_back(meshes[i].path);
+        if (!SceneFile::write(sceneOutput, scene, 0, scene.size(), meshPaths, fanHubs))
+            return -1;
+        std::cout << scene.size() << " nodes written to " << sceneOutput << std::endl;
+        return 0;
+    }
+
+    // camera matrices live in one uniform buffer shared by every program
+    FrameUniformBuffer frameUniforms;
+    frameUniforms.init();
+    frameUniforms.attach(ourShader);
+    frameUniforms.attach(constantShader);
+    frameUniforms.attach(instancedShader);
+    frameUniforms.attach(bakedShader);
+    if (indirectShader)
+        frameUniforms.attach(*indirectShader);
+
+    // the light lists are rebuilt every frame into buffers bound once here
+    if (lighting) {
+        lightClusters.init(NEAR_PLANE, FAR_PLANE, AMBIENT_LIGHT);
+        lightClusters.attach(ourShader);
+        lightClusters.attach(instancedShader);
+        lightClusters.attach(bakedShader);
+        if (indirectShader)
+            lightClusters.attach(*indirectShader);
+    }
+
+    // baked vertices are already in world space
+    bakedShader.use();
+    bakedShader.setMat4("model", glm::mat4(1.0f));
+
+    // edits to the shader files are picked up while the program runs, and built on a context of their own
+    ShaderWatcher shaderWatcher;
+    GLFWwindow* buildWindow = NULL;
+    if (hotReload || !headlessMode) {
+        SharedBuildContext buildContext;
+        if (headlessMode) {
+            if (headlessContext.createShared()) {
+                buildContext.makeCurrent = [&headlessContext]() { return headlessContext.makeSharedCurrent(); };
+                buildContext.release = [&headlessContext]() { headlessContext.releaseShared(); };
+            }
+        }
+        else {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            buildWindow = glfwCreateWindow(1, 1, "shader builds", NULL, window);
+            if (buildWindow) {
+                buildContext.makeCurrent = [buildWindow]() { glfwMakeContextCurrent(buildWindow); return true; };
+                buildContext.release = []() { glfwMakeContextCurrent(NULL); };
+            }
+        }
+        shaderWatcher.watch(ourShader);
+        shaderWatcher.watch(constantShader);
+        shaderWatcher.watch(instancedShader);
+        shaderWatcher.watch(bakedShader);
+        if (indirectShader)
+            shaderWatcher.watch(*indirectShader);
+        shaderWatcher.start(buildContext.makeCurrent ? &buildContext : NULL);
+    }
+
+    if (headlessMode && !offscreenTarget.create(SCR_WIDTH, SCR_HEIGHT))
+        return -1;
+
     ourShader.use();
     //constantShader.use();
     r = 0.0f;
+
+    // wall-clock cost of every frame, reported at the end of a headless run
+    std::vector<double> frameTimes;
+    int frameCount = 0;
+    long long totalVisible = 0, totalCulled = 0, totalOccluded = 0;
+    long long totalLights = 0, totalLightIndices = 0;
+    size_t busiestCluster = 0;
+    long long totalDraws = 0, totalProgramChanges = 0, totalVaoChanges = 0, totalColorChanges = 0;
+    int titleVisible = -1;
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (!quitRequested && (headlessMode ? frameCount < headlessFrames : !glfwWindowShouldClose(window)))
     {
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        GLState::instance().beginFrame();
+        PROFILE_FRAME();
+        PROFILE_SCOPE("frame");
+
         // per-frame time logic
         // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        float currentFrame = advanceClock(frameCount, !headlessMode);
+
+        // follow edits of the scene file
+        if (sceneFileNodes > 0 && (hotReload || !headlessMode) && currentFrame - lastSceneCheck >= SCENE_CHECK_INTERVAL) {
+            lastSceneCheck = currentFrame;
+            if (sceneFile.changedOnDisk())
+                reloadScene();
+        }
+
+        // swap in shaders that finished rebuilding; a reloaded program starts with default uniform state
+        const std::vector<Shader*>& reloaded = shaderWatcher.poll();
+        for (size_t i = 0; i < reloaded.size(); i++) {
+            frameUniforms.attach(*reloaded[i]);
+            if (lighting && reloaded[i] != &constantShader)
+                lightClusters.attach(*reloaded[i]);
+            if (reloaded[i] == &bakedShader) {
+                bakedShader.use();
+                bakedShader.setMat4("model", glm::mat4(1.0f));
+            }
+            ourShader.use();
+        }
 
         // input
         // -----
-        processInput(window);
+        InputFrame input;
+        {
+            PROFILE_SCOPE("input");
+            if (inputReplay.isActive()) {
+                // the run ends with the recording
+                if (!inputReplay.next(input))
+                    break;
+            }
+            else if (!headlessMode) {
+                input = sampleInput(window);
+            }
+            input.deltaTime = deltaTime;
+            inputRecorder.record(input);
+            processInput(input);
+        }
+
+        // simulation: as many fixed ticks as the elapsed time pays for, then render between the last two
+        // -----
+        {
+            PROFILE_SCOPE("simulation");
+            stepSimulation(input);
+        }
+        SimulationState state = interpolatedState();
 
         // render
         // ------
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        {
+            PROFILE_GPU_SCOPE("clear");
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
 
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(basic_camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
-        ourShader.setMat4("projection", projection);
-        //constantShader.setMat4("projection", projection);
+        glm::mat4 projection, view;
+        glm::vec3 cameraPosition;
+        cameraMatrices(projection, view, cameraPosition, state);
 
-        glm::mat4 view;
+        // one upload serves ourShader, constantShader and instancedShader alike
+        frameUniforms.update(view, projection, cameraPosition, currentFrame);
 
-        if (birdEyeView) {
-            // Set camera position directly above the scene
-            glm::vec3 up(0.0f, 1.0f, 0.0f); // Ensure the up vector points backward
-            view = glm::lookAt(birdEyePosition, birdEyeTarget, up);
+        // pose the fan; only the hub subtree is recomputed, and nothing at all while the fan is off
+        {
+            PROFILE_SCOPE("scene update");
+            for (size_t i = 0; i < fanHubs.size(); i++)
+                scene.setYaw(fanHubs[i], fanOn ? state.fanAngle : 0.0f);
+            scene.update(jobs);
+            syncStaticBatch(scene);
+            syncBounds(scene);
+            cullScene(scene, projection * view);
         }
-        else {
-            view = basic_camera.createViewMatrix();
-        }
-
-        ourShader.setMat4("view", view);
-        // camera/view transformation
-        //glm::mat4 view = basic_camera.createViewMatrix();
-        //ourShader.setMat4("view", view);
-        //constantShader.setMat4("view", view);
-
-        // Modelling Transformation
-        //glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        //drawCube(ourShader, VAO, identityMatrix, translate_X, translate_Y, translate_Z, rotateAngle_X, rotateAngle_Y, rotateAngle_Z, scale_X, scale_Y, scale_Z);
-        glm::mat4 identityMatrix = glm::mat4(1.0f);
-        glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model, RotateTranslateMatrix, InvRotateTranslateMatrix;
-
-        drawTableChair(VAO, ourShader);
-        drawFan(VAO, ourShader);
-
-        //floor
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.5f, -1.0f, -4.1f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(10.0f, -0.2f, 14.2f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.494f, 0.514f, 0.541f, 1.0f));
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //front wall
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.5f, -1.0f, -4.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(10.0f, 7.0f, -0.2f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.659f, 0.820f, 0.843f, 1.0f));
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //left wall section 1
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.5f, -1.0f, -4.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 7.0f, 14.0f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //roof
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.5f, 2.5f, -4.1f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(10.0f, 0.2f, 14.2f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.494f, 0.514f, 0.541f, 1.0f));
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //whiteboard
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -4.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(5.0f, 3.0f, 0.2f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+
+        if (lighting) {
+            PROFILE_SCOPE("light clusters");
+            lightClusters.update(jobs, scene, pointLights, view, projection);
+            totalLights += lightClusters.visibleLights;
+            totalLightIndices += lightClusters.assignedIndices;
+            busiestCluster = std::max(busiestCluster, lightClusters.busiestCluster);
+        }
+
+        // picking reads the cursor position only on the frame the button goes down
+        if (!headlessMode) {
+            bool mouseDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+            if (mouseDown && !mouseWasDown) {
+                glfwGetCursorPos(window, &pickX, &pickY);
+                pickRequested = true;
+            }
+            mouseWasDown = mouseDown;
+        }
+        else if (headlessPick && frameCount == headlessFrames - 1) {
+            pickRequested = true;
+        }
+        if (pickRequested) {
+            std::chrono::steady_clock::time_point pickStart = std::chrono::steady_clock::now();
+            int picked = pickObject(scene, pickX, pickY, projection * view, cameraPosition);
+            double pickTime = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+            if (picked == -1)
+                std::cout << "picked nothing at (" << pickX << ", " << pickY << ")";
+            else
+                std::cout << "picked \"" << scene.names[picked] << "\" at (" << pickX << ", " << pickY << ")";
+            std::cout << " in " << pickTime << " us" << std::endl;
+            pickRequested = false;
+        }
+
+        // the baked batch is the room shell and table set, the per-frame boxes are the fan
+        if (staticBaking) {
+            PROFILE_GPU_SCOPE("draw static");
+            bakedShader.use();
+            if (frustumCulling)
+                staticBatch.drawVisible(slotVisible.data());
+            else
+                staticBatch.draw();
+            ourShader.use();
+        }
+
+        {
+            PROFILE_GPU_SCOPE("draw dynamic");
+            cubeBatch.clear();
+            indirectBatch.clear();
+            drawScene(VAO, ourShader, scene, cameraPosition);
+
+            if (instancedRendering) {
+                instancedShader.use();
+                cubeBatch.draw();
+                ourShader.use();
+            }
+            else if (multiDrawIndirect) {
+                indirectShader->use();
+                indirectBatch.draw();
+                ourShader.use();
+            }
+        }
+
+        {
+            PROFILE_GPU_SCOPE("swap");
+            if (headlessMode) {
+                // nothing presents the frame, so wait for it to finish to time the real rendering cost
+                glFinish();
+            }
+            else {
+                // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+                // -------------------------------------------------------------------------------
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+        }
+
+        if (!instancedRendering && !multiDrawIndirect) {
+            totalDraws += drawQueue.size();
+            totalProgramChanges += drawQueue.programChanges;
+            totalVaoChanges += drawQueue.vaoChanges;
+            totalColorChanges += drawQueue.colorChanges;
+        }
+        if (frustumCulling) {
+            totalVisible += visibleBoxes;
+            totalCulled += culledBoxes;
+            totalOccluded += occludedBoxes;
+            // the title is only touched when the counts move
+            if (!headlessMode && visibleBoxes != titleVisible) {
+                char title[128];
+                snprintf(title, sizeof(title), "CSE 4208: Computer Graphics Laboratory (visible %d, culled %d)", visibleBoxes, culledBoxes);
+                glfwSetWindowTitle(window, title);
+                titleVisible = visibleBoxes;
+            }
+        }
+
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        frameCount++;
+    }
+
+    inputRecorder.finish();
+    shaderWatcher.stop();
+    if (buildWindow)
+        glfwDestroyWindow(buildWindow);
+
+#ifdef ENABLE_PROFILER
+    Profiler::instance().report();
+    if (profileOutput)
+        Profiler::instance().write(profileOutput);
+#endif
+
+    if (headlessMode)
+    {
+        printFrameStats(frameTimes);
+        if (frustumCulling && frameCount > 0)
+            std::cout << "culling: " << (double)totalVisible / frameCount << " visible, "
+                      << (double)totalCulled / frameCount << " culled boxes per frame ("
+                      << (double)totalOccluded / frameCount << " of them occluded)" << std::endl;
+        if (lighting && frameCount > 0)
+            std::cout << "lighting: " << pointLights.size() << " lights, " << (double)totalLights / frameCount << " in view, "
+                      << (double)totalLightIndices / frameCount / LightClusters::CLUSTER_COUNT << " per cluster on average, at most "
+                      << busiestCluster << " in one cluster" << std::endl;
+        if (!instancedRendering && !multiDrawIndirect && frameCount > 0)
+            std::cout << "draw queue: " << (double)totalDraws / frameCount << " draws, "
+                      << (double)totalProgramChanges / frameCount << " program, "
+                      << (double)totalVaoChanges / frameCount << " VAO, "
+                      << (double)totalColorChanges / frameCount << " color changes per frame" << std::endl;
+        if (instancedRendering || multiDrawIndirect) {
+            const RingBuffer& ring = instancedRendering ? cubeBatch.instances : indirectBatch.records;
+            if (ring.isPersistent())
+                std::cout << "per-frame data: persistently mapped, " << RingBuffer::FRAMES_IN_FLIGHT << " frames in flight, "
+                          << ring.stalls << " waits for the GPU" << std::endl;
+            else
+                std::cout << "per-frame data: uploaded with glBufferSubData" << std::endl;
+        }
+        GLState::instance().beginFrame();
+        GLState::instance().report();
+        std::cout << "memory: " << peakResidentBytes() / (1024 * 1024) << " MiB peak resident" << std::endl;
+        if (headlessOutput && offscreenTarget.writePPM(headlessOutput))
+            std::cout << "final frame written to " << headlessOutput << std::endl;
+        offscreenTarget.destroy();
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    GLState::instance().deleteVertexArray(VAO);
+    GLState::instance().deleteBuffer(VBO);
+    GLState::instance().deleteBuffer(EBO);
+    cubeBatch.destroy();
+    indirectBatch.destroy();
+    for (size_t i = 0; i < meshes.size(); i++)
+        meshes[i].destroy();
+    staticBatch.destroy();
+    frameUniforms.destroy();
+    if (lighting)
+        lightClusters.destroy();
+
+    if (ourShader.uniformCacheMisses > 0 || instancedShader.uniformCacheMisses > 0)
+        std::cout << "uniform cache misses: " << ourShader.uniformCacheMisses << " (ourShader), "
+                  << instancedShader.uniformCacheMisses << " (instancedShader)" << std::endl;
+
+    if (headlessMode) {
+        headlessContext.destroy();
+        return 0;
+    }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -305,450 +881,644 @@ int main()
     return 0;
 }
 
-void drawFan(unsigned int VAO, Shader ourShader) {
-    glm::mat4 identityMatrix = glm::mat4(1.0f);
-    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model, RotateTranslateMatrix, InvRotateTranslateMatrix;
-
-    if (fanOn) {
-        //fan rod
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.95f, 2.5f, 0.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan middle
-        rotateYMatrix = createRotateYMatrix(r);
-        //rotateYMatrix = glm::rotate(identityMatrix, glm::radians(r), glm::vec3(0.0f, 1.0f, 0.0f));
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.8f, 2.0f, -0.15f));
-        RotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(-0.2f, 0.0f, -0.2f));
-        InvRotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(0.2f, 0.0f, 0.2f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.8f, -0.2f, 0.8f));
-        model = translateMatrix * InvRotateTranslateMatrix * rotateYMatrix * RotateTranslateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan propelars left
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.8f, 2.0f, -0.05f));
-        RotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(-0.2f, 0.0f, -0.1f));
-        InvRotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(0.2f, 0.0f, 0.1f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(-1.5f, -0.2f, 0.4f));
-        model = translateMatrix * InvRotateTranslateMatrix * rotateYMatrix * RotateTranslateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan propelars right
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.2f, 2.0f, -0.05f));
-        RotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(0.2f, 0.0f, -0.1f));
-        InvRotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(-0.2f, 0.0f, 0.1f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.5f, -0.2f, 0.4f));
-        model = translateMatrix * InvRotateTranslateMatrix * rotateYMatrix * RotateTranslateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan propelars up
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.9f, 2.0f, -0.15f));
-        RotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(-0.1f, 0.0f, -0.2f));
-        InvRotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(0.1f, 0.0f, 0.2f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4f, -0.2f, -1.5f));
-        model = translateMatrix * InvRotateTranslateMatrix * rotateYMatrix * RotateTranslateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan propelars down
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.9f, 2.0f, 0.25f));
-        RotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(-0.1f, 0.0f, 0.2f));
-        InvRotateTranslateMatrix = glm::translate(identityMatrix, glm::vec3(0.1f, 0.0f, -0.2f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4f, -0.2f, 1.5f));
-        model = translateMatrix * InvRotateTranslateMatrix * rotateYMatrix * RotateTranslateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        r += 0.5f;
+// the simulated state as of the last tick
+// ---------------------------------------
+SimulationState captureState()
+{
+    SimulationState state;
+    state.eye = basic_camera.eye;
+    state.lookAt = basic_camera.lookAt;
+    state.birdEyePosition = birdEyePosition;
+    state.birdEyeTarget = birdEyeTarget;
+    state.fanAngle = r;
+    return state;
+}
+
+// set deltaTime and lastFrame for this frame and return the frame's time. A replay advances by the frame
+// times it recorded, so the simulation takes the same ticks as the recorded session (or by its fixed step,
+// and so do recordings without frame times); other headless runs use a fixed 60 Hz clock so every run
+// sees the same frames, and windowed runs the wall clock
+// --------------------------------------------------------------------------------------------
+float advanceClock(int frameCount, bool wallClock)
+{
+    if (inputReplay.isActive() && inputReplay.usesFrameTimes()) {
+        deltaTime = inputReplay.nextDeltaTime();
+        lastFrame += deltaTime;
+        return lastFrame;
+    }
+    float currentFrame;
+    if (inputReplay.isActive())
+        currentFrame = frameCount * inputReplay.fixedDeltaTime;
+    else if (wallClock)
+        currentFrame = static_cast<float>(glfwGetTime());
+    else
+        currentFrame = frameCount / 60.0f;
+    deltaTime = currentFrame - lastFrame;
+    lastFrame = currentFrame;
+    return currentFrame;
+}
+
+// run the ticks this frame's deltaTime pays for; the remainder carries over to the next frame
+// --------------------------------------------------------------------------------------------
+void stepSimulation(const InputFrame& input)
+{
+    simulationAccumulator += std::min(deltaTime, MAX_FRAME_TIME);
+    // deltaTime is a difference of float clock readings, so a frame that is exactly one step long can come
+    // out a hair short; without the slack such frames would alternate between zero and two ticks
+    while (simulationAccumulator >= simulationStep * 0.999f) {
+        previousState = currentState;
+        simulate(input, simulationStep);
+        currentState = captureState();
+        simulationAccumulator -= simulationStep;
+    }
+}
+
+// what to render this frame: the last two ticks blended by how far we are into the next one
+// ------------------------------------------------------------------------------------------
+SimulationState interpolatedState()
+{
+    float alpha = std::min(std::max(simulationAccumulator / simulationStep, 0.0f), 1.0f);
+    SimulationState state;
+    state.eye = glm::mix(previousState.eye, currentState.eye, alpha);
+    state.lookAt = glm::mix(previousState.lookAt, currentState.lookAt, alpha);
+    state.birdEyePosition = glm::mix(previousState.birdEyePosition, currentState.birdEyePosition, alpha);
+    state.birdEyeTarget = glm::mix(previousState.birdEyeTarget, currentState.birdEyeTarget, alpha);
+    state.fanAngle = previousState.fanAngle + (currentState.fanAngle - previousState.fanAngle) * alpha;
+    return state;
+}
+
+// projection and view of the active camera (bird's-eye or the basic camera) at the given state
+// -----------------------------------------------------------------------------------------------
+void cameraMatrices(glm::mat4& projection, glm::mat4& view, glm::vec3& cameraPosition, const SimulationState& state)
+{
+    // projection matrix (note that in this case it could change every frame)
+    projection = glm::perspective(glm::radians(basic_camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+    //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
+
+    if (birdEyeView) {
+        // Set camera position directly above the scene
+        glm::vec3 up(0.0f, 1.0f, 0.0f); // Ensure the up vector points backward
+        view = glm::lookAt(state.birdEyePosition, state.birdEyeTarget, up);
+        cameraPosition = state.birdEyePosition;
+    }
+    else {
+        // a copy, so rendering never writes to the simulated camera
+        BasicCamera camera = basic_camera;
+        camera.eye = state.eye;
+        camera.lookAt = state.lookAt;
+        view = camera.createViewMatrix();
+        cameraPosition = state.eye;
+    }
+}
+
+// CPU backend: the same scene, camera and input path as the GL loop, rasterized into memory; the final
+// frame is written to --output. Needs no window, GL context or GPU.
+// ------------------------------------------------------------------------------------------------------
+int runSoftwareRenderer()
+{
+    SoftwareRasterizer rasterizer;
+    rasterizer.init(SCR_WIDTH, SCR_HEIGHT, jobs);
+    rasterizer.setMesh(cube_vertices, (int)(sizeof(cube_vertices) / (6 * sizeof(float))), cube_indices, (int)(sizeof(cube_indices) / sizeof(unsigned int)));
+    std::cout << "software renderer: " << jobs.threadCount() << " threads, unlit (compare with GL runs made with --no-lighting)" << std::endl;
+
+    // nothing is baked or instanced here, every visible box is one draw
+    if (!meshPlacements.empty())
+        std::cout << "--mesh ignored: the software renderer only draws boxes" << std::endl;
+    staticBaking = false;
+    instancedRendering = false;
+    if (!buildScene())
+        return -1;
+
+    std::vector<double> frameTimes;
+    int frameCount = 0;
+    while (!quitRequested && frameCount < headlessFrames)
+    {
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+
+        advanceClock(frameCount, false);
+
+        InputFrame input;
+        if (inputReplay.isActive() && !inputReplay.next(input))
+            break;
+        input.deltaTime = deltaTime;
+        inputRecorder.record(input);
+        processInput(input);
+        stepSimulation(input);
+        SimulationState state = interpolatedState();
+
+        glm::mat4 projection, view;
+        glm::vec3 cameraPosition;
+        cameraMatrices(projection, view, cameraPosition, state);
+
+        for (size_t i = 0; i < fanHubs.size(); i++)
+            scene.setYaw(fanHubs[i], fanOn ? state.fanAngle : 0.0f);
+        scene.update(jobs);
+        syncBounds(scene);
+        cullScene(scene, projection * view);
+
+        rasterizer.beginFrame(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f), projection * view);
+        for (size_t i = 0; i < scene.size(); i++)
+        {
+            if (!scene.drawable[i] || (frustumCulling && !nodeVisible[i]))
+                continue;
+            rasterizer.submit(scene.model[i], scene.color[i]);
+        }
+        rasterizer.endFrame();
+
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        frameCount++;
+    }
+
+    inputRecorder.finish();
+    printFrameStats(frameTimes);
+    std::cout << "memory: " << peakResidentBytes() / (1024 * 1024) << " MiB peak resident" << std::endl;
+    if (headlessOutput && rasterizer.writePPM(headlessOutput))
+        std::cout << "final frame written to " << headlessOutput << std::endl;
+    jobs.stop();
+    return 0;
+}
+
+// index of the mesh loaded from path, loading it on first use; -1 when it cannot be drawn
+// ------------------------------------------------------------------------------------------
+int resolveMesh(const StringView& path)
+{
+    // the software renderer only draws boxes
+    if (softwareRenderer)
+        return -1;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        if (path == meshes[i].path)
+            return (int)i;
+    }
+    MeshAsset asset;
+    if (!asset.load(path.str().c_str()))
+        return -1;
+    meshes.push_back(asset);
+    return (int)meshes.size() - 1;
+}
+
+// fill the empty scene: the scene file (or the built-in room when the default file is missing), then the
+// --mesh placements
+// ------------------------------------------------------------------------------------------
+bool buildScene(bool sceneFileLoaded)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    sceneFileNodes = 0;
+    if (roomRows > 0) {
+        buildRoomGrid(scene, roomRows, roomColumns, roomSeed, fanHubs);
+        size_t boxes = 0;
+        for (size_t i = 0; i < scene.size(); i++)
+            boxes += scene.drawable[i];
+        std::cout << roomRows << " x " << roomColumns << " rooms (seed " << roomSeed << "): " << scene.size() << " nodes, "
+                  << boxes << " boxes in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+    }
+    else if (sceneFileLoaded || sceneFile.load(scenePath)) {
+        sceneFile.instantiate(scene, resolveMesh, fanHubs);
+        sceneFileNodes = scene.size();
+        std::cout << "scene " << scenePath << ": " << sceneFileNodes << " nodes in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+    }
+    else if (scenePathGiven) {
+        return false;
+    }
+    else {
+        std::cout << "building the default room" << std::endl;
+        int hub;
+        buildLivingRoom(scene, -1, glm::vec3(0.0f), &hub);
+        fanHubs.push_back(hub);
+    }
+
+    // meshes are drawn one by one with ourShader, in the color of their node
+    if (!softwareRenderer) {
+        for (size_t i = 0; i < meshPlacements.size(); i++)
+        {
+            StringView path = { meshPlacements[i].path, strlen(meshPlacements[i].path) };
+            int mesh = resolveMesh(path);
+            if (mesh != -1)
+                scene.addMesh(meshPlacements[i].path, -1, mesh, meshPlacements[i].position, glm::vec3(1.0f),
+                              glm::vec4(0.75f, 0.75f, 0.75f, 1.0f));
+        }
+    }
+    placeLights(scene);
+    return true;
+}
+
+// four ceiling lights in every room and a lamp over every table set, following their nodes; --lights adds
+// random ones inside the rooms, the same ones for the same --seed
+// ------------------------------------------------------------------------------------------
+void placeLights(const SceneGraph& scene)
+{
+    pointLights.clear();
+    if (!lighting)
+        return;
+    glm::vec3 ceilingColor(0.55f, 0.5f, 0.42f);
+    glm::vec3 lampColor(0.45f, 0.35f, 0.22f);
+    std::vector<int> rooms;
+    for (size_t i = 0; i < scene.size(); i++)
+    {
+        PointLight light;
+        light.node = (int)i;
+        if (scene.names[i] == "room") {
+            rooms.push_back((int)i);
+            const float xs[2] = { -0.25f, 2.25f };
+            const float zs[2] = { -2.25f, 1.5f };
+            for (int corner = 0; corner < 4; corner++)
+            {
+                light.offset = glm::vec3(xs[corner & 1], 2.2f, zs[corner >> 1]);
+                light.color = ceilingColor;
+                light.radius = 7.0f;
+                pointLights.push_back(light);
+            }
+        }
+        else if (scene.names[i] == "table set") {
+            light.offset = glm::vec3(1.0f, 0.6f, 0.5f);
+            light.color = lampColor;
+            light.radius = 3.0f;
+            pointLights.push_back(light);
+        }
+    }
+
+    RoomRandom random(roomSeed);
+    for (int i = 0; i < extraLights && !rooms.empty(); i++)
+    {
+        PointLight light;
+        light.node = rooms[random.below((int)rooms.size())];
+        light.offset = glm::vec3(random.uniform(-1.2f, 3.2f), random.uniform(-0.8f, 2.3f), random.uniform(-3.7f, 2.8f));
+        light.color = glm::vec3(random.uniform(0.05f, 0.3f), random.uniform(0.05f, 0.3f), random.uniform(0.05f, 0.3f));
+        light.radius = random.uniform(1.0f, 3.0f);
+        pointLights.push_back(light);
     }
+}
 
+// apply a changed scene file: edits in place when the nodes still line up with the file, otherwise the scene
+// and everything derived from it is rebuilt
+// ------------------------------------------------------------------------------------------
+void reloadScene()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SceneFile::ReloadResult result = sceneFile.reload(scene, 0, sceneFileNodes, resolveMesh, fanHubs);
+    if (result == SceneFile::RELOAD_FAILED) {
+        std::cout << "keeping the previous scene" << std::endl;
+        return;
+    }
+    if (result == SceneFile::RELOAD_REBUILD) {
+        scene.clear();
+        fanHubs.clear();
+        staticBatch.clear();
+        staticSlot.clear();
+        sceneBVH = BVH();
+        // reload() has just read the file
+        buildScene(true);
+        std::cout << "scene " << scenePath << " rebuilt";
+    }
     else {
-        //fan rod
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.95f, 2.5f, 0.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan middle
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.8f, 2.0f, -0.15f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.8f, -0.2f, 0.8f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan propelars left
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.8f, 2.0f, -0.05f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(-1.5f, -0.2f, 0.4f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan propelars right
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.2f, 2.0f, -0.05f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.5f, -0.2f, 0.4f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan propelars up
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.9f, 2.0f, -0.15f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4f, -0.2f, -1.5f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-        //fan propelars down
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.9f, 2.0f, 0.25f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4f, -0.2f, 1.5f));
-        model = translateMatrix * scaleMatrix;
-        ourShader.setMat4("model", model);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        std::cout << "scene " << scenePath << " reloaded, " << sceneFile.nodesChanged << " nodes changed";
     }
+    std::cout << " in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
 }
 
-void drawTableChair(unsigned int VAO, Shader ourShader) {
-    //table top
-    glm::mat4 identityMatrix = glm::mat4(1.0f);
-    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model;
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(4.0f, 0.2f, 2.0f));
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, -0.5f, 0.0f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.882f, 0.710f, 0.604f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //table leg left back
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, -0.5f, 0.0f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.647f, 0.408f, 0.294f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //table leg right back
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.9f, -0.5f, 0.0f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //table leg left front
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, -0.5f, 0.9f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //table leg right frint
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.9f, -0.5f, 0.9f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair mid section
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.25f, -0.5f, 1.15f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0f, 0.2f, 1.0f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.455f, 0.235f, 0.102f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair leg back left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.25f, -0.5f, 1.15f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.329f, 0.173f, 0.110f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair leg front left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.25f, -0.5f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair leg front right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.65f, -0.5f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair leg back right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.65f, -0.5f, 1.15f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper piller left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.25f, -0.4f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 1.3f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper piller right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.65f, -0.4f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 1.3f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper line
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.25f, 0.15f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0f, 0.2f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper mid line
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.25f, -0.20f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0f, 0.2f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair mid section
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.25f, -0.5f, 1.15f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0f, 0.2f, 1.0f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.455f, 0.235f, 0.102f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair leg back left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.25f, -0.5f, 1.15f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.329f, 0.173f, 0.110f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair leg front left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.25f, -0.5f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair leg front right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.65f, -0.5f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair leg back right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.65f, -0.5f, 1.15f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper piller left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.25f, -0.4f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 1.3f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper piller right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.65f, -0.4f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 1.3f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper line
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.25f, 0.15f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0f, 0.2f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper mid line
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.25f, -0.20f, 1.55f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0f, 0.2f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair mid section
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.75f, -0.5f, 0.25f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0f, 0.2f, 1.0f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.455f, 0.235f, 0.102f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    
-    //chair leg back left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.75f, -0.5f, 0.25f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.329f, 0.173f, 0.110f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-    
-    //chair leg front left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.75f, -0.5f, 0.65f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-    
-    //chair leg front right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.35f, -0.5f, 0.25f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-    
-    //chair leg back right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.35f, -0.5f, 0.65f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -1.0f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-    
-    //chair upper piller left
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.75f, -0.4f, 0.25f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 1.3f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper piller right
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.75f, -0.4f, 0.65f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 1.3f, 0.2f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-    
-    //chair upper line
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.75f, 0.15f, 0.25f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 0.2f, 1.0f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-
-    //chair upper mid line
-    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.75f, -0.20f, 0.25f));
-    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, 0.2f, 1.0f));
-    model = translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+// frame count, total and min/avg/median/p95/max frame time of a run
+// -----------------------------------------------------------------
+void printFrameStats(std::vector<double> frameTimes)
+{
+    if (frameTimes.empty())
+        return;
+
+    double total = 0.0;
+    for (size_t i = 0; i < frameTimes.size(); i++)
+        total += frameTimes[i];
+    std::sort(frameTimes.begin(), frameTimes.end());
+
+    std::cout << "frames: " << frameTimes.size()
+              << "  total: " << total << " ms"
+              << "  avg: " << total / frameTimes.size() << " ms"
+              << "  min: " << frameTimes.front() << " ms"
+              << "  median: " << frameTimes[frameTimes.size() / 2] << " ms"
+              << "  p95: " << frameTimes[(frameTimes.size() * 95) / 100] << " ms"
+              << "  max: " << frameTimes.back() << " ms"
+              << "  (" << 1000.0 * frameTimes.size() / total << " fps)" << std::endl;
 }
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow* window)
+// command line options
+// -----------------------------------------------------------------
+void printUsage(const char* program)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+    std::cout << "usage: " << program << " [options]\n"
+              << "rendering:\n"
+              << "  --renderer gl|software    software rasterizes on the CPU; it draws flat colors only, so compare its\n"
+              << "                            images with GL runs made with --no-lighting (the software run never lights)\n"
+              << "  --no-lighting             flat colors instead of clustered Blinn-Phong lighting\n"
+              << "  --lights n                n extra random point lights\n"
+              << "  --no-instancing           one draw per dynamic box instead of the instance batch\n"
+              << "  --multi-draw-indirect     every box through one indirect draw (GL 4.3)\n"
+              << "  --no-static-batch         draw static boxes like dynamic ones\n"
+              << "  --no-culling              no frustum (or occlusion) culling\n"
+              << "  --no-occlusion            frustum culling only\n"
+              << "  --no-persistent-map       upload per-frame data with glBufferSubData\n"
+              << "  --no-state-cache          issue every GL state change\n"
+              << "  --shader-cache dir        where program binaries are cached (default shader_cache)\n"
+              << "  --no-shader-cache         always build programs from source\n"
+              << "  --hot-reload              reload edited shaders in headless runs too\n"
+              << "scene:\n"
+              << "  --scene file              .scene or .sceneb to load (default living_room.scene)\n"
+              << "  --write-scene file        save the scene and exit\n"
+              << "  --rooms rows columns      a generated grid of rooms instead of the scene file\n"
+              << "  --seed n                  seed of the generated rooms and lights\n"
+              << "  --mesh file x y z         place a .mesh file\n"
+              << "  --fan-on                  start with the fan spinning\n"
+              << "runs:\n"
+              << "  --headless                render offscreen through EGL, no window\n"
+              << "  --software-gl             ask for Mesa's llvmpipe\n"
+              << "  --frames n                headless frame count (default 300)\n"
+              << "  --output file.ppm         write the last headless frame\n"
+              << "  --record file             record the input and frame times\n"
+              << "  --replay file             replay recorded input with its frame times\n"
+              << "  --replay-fixed-step       replay at a fixed 60 Hz instead of the recorded frame times\n"
+              << "  --sim-hz hz               fixed simulation rate (default 60)\n"
+              << "  --threads n               worker threads (0 = one per hardware thread)\n"
+              << "  --pick x y                pick at a pixel on the last headless frame\n"
+              << "  --profile file            write the profiler timings (.json or CSV)" << std::endl;
+}
 
-    if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS)
+// draw every box and mesh node of the scene graph with its current model matrix and color;
+// static boxes are skipped when they are already in the baked batch. Jobs fill one
+// queue per node range; the GL thread merges them, sorts by key and then either
+// feeds the instance or indirect batch front to back (in the key's depth bands), or
+// submits the draws one by one.
+// ---------------------------------------------------------------------------------
+void drawScene(unsigned int VAO, const Shader& ourShader, const SceneGraph& scene, const glm::vec3& eye)
+{
+    int rangeCount = ((int)scene.size() + NODES_PER_JOB - 1) / NODES_PER_JOB;
+    if ((int)rangeQueues.size() < rangeCount)
+        rangeQueues.resize(rangeCount);
+    jobs.parallelFor(rangeCount, [&](int range, int) {
+        DrawQueue& queue = rangeQueues[range];
+        queue.clear();
+        size_t end = std::min(scene.size(), (size_t)(range + 1) * NODES_PER_JOB);
+        for (size_t i = (size_t)range * NODES_PER_JOB; i < end; i++)
+        {
+            if (!scene.drawable[i])
+                continue;
+            if (staticBaking && !scene.dynamic[i] && scene.mesh[i] == -1)
+                continue;
+            if (frustumCulling && !nodeVisible[i])
+                continue;
+            // distance to the center of the box or mesh bounds
+            glm::vec3 boundsMin, boundsMax;
+            localBounds(scene, (int)i, boundsMin, boundsMax);
+            glm::vec3 center = glm::vec3(scene.model[i] * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+            float depth = glm::length(center - eye) / FAR_PLANE;
+            if (scene.mesh[i] == -1) {
+                uint64_t key = DrawQueue::makeKey(DrawQueue::PASS_OPAQUE, scene.color[i], depth);
+                queue.add(key, scene.model[i], scene.color[i], ourShader, VAO, 36);
+            }
+            else {
+                const MeshAsset& asset = meshes[scene.mesh[i]];
+                uint64_t key = DrawQueue::makeKey(DrawQueue::PASS_OPAQUE, scene.color[i], depth);
+                queue.add(key, scene.model[i] * asset.dequantize, scene.color[i], ourShader, asset.VAO, asset.indexCount, asset.indexType);
+            }
+        }
+    });
+
+    drawQueue.clear();
+    for (int range = 0; range < rangeCount; range++)
+        drawQueue.append(rangeQueues[range]);
+    drawQueue.sort();
+
+    if (!instancedRendering && !multiDrawIndirect) {
+        drawQueue.submit();
+        return;
+    }
+
+    // the batches only know the cube; meshes have their own VAOs, so the key keeps each mesh's draws
+    // together and they are submitted run by run
+    if (instancedRendering)
+        cubeBatch.begin(drawQueue.size());
+    else
+        indirectBatch.begin(drawQueue.size());
+    size_t i = 0;
+    while (i < drawQueue.size()) {
+        if (drawQueue[i].VAO != VAO) {
+            size_t runEnd = i + 1;
+            while (runEnd < drawQueue.size() && drawQueue[runEnd].VAO != VAO)
+                runEnd++;
+            drawQueue.submit(i, runEnd);
+            i = runEnd;
+            continue;
+        }
+        if (instancedRendering)
+            cubeBatch.add(drawQueue[i].model, drawQueue[i].color);
+        else
+            indirectBatch.add(drawQueue[i].model, drawQueue[i].color);
+        i++;
+    }
+}
+
+// bake static boxes that were added or edited in the last scene.update(); untouched boxes are not re-uploaded
+// ------------------------------------------------------------------------------------------------------------
+void syncStaticBatch(const SceneGraph& scene)
+{
+    if (!staticBaking)
+        return;
+
+    staticSlot.resize(scene.size(), -1);
+    for (size_t c = 0; c < scene.changed.size(); c++)
+    {
+        int node = scene.changed[c];
+        if (!scene.drawable[node] || scene.dynamic[node] || scene.mesh[node] != -1)
+            continue;
+        if (staticSlot[node] == -1)
+            staticSlot[node] = staticBatch.add(scene.model[node], scene.color[node]);
+        else
+            staticBatch.update(staticSlot[node], scene.model[node], scene.color[node]);
+    }
+    staticBatch.upload();
+}
+
+// refresh the world-space bounds of boxes changed by the last scene.update(); the BVH is rebuilt when boxes
+// were added and only refit when existing ones moved
+// -----------------------------------------------------------------------------------------------------------
+void syncBounds(const SceneGraph& scene)
+{
+    if (scene.changed.empty())
+        return;
+
+    sceneBounds.resize(scene.size());
+    int rangeCount = ((int)scene.changed.size() + NODES_PER_JOB - 1) / NODES_PER_JOB;
+    jobs.parallelFor(rangeCount, [&](int range, int) {
+        size_t end = std::min(scene.changed.size(), (size_t)(range + 1) * NODES_PER_JOB);
+        for (size_t c = (size_t)range * NODES_PER_JOB; c < end; c++)
+        {
+            int node = scene.changed[c];
+            if (scene.drawable[node]) {
+                glm::vec3 boundsMin, boundsMax;
+                localBounds(scene, node, boundsMin, boundsMax);
+                sceneBounds.set(node, scene.model[node], boundsMin, boundsMax);
+            }
+        }
+    });
+
+    size_t drawableCount = 0;
+    for (size_t i = 0; i < scene.size(); i++)
+        drawableCount += scene.drawable[i];
+
+    if (drawableCount != sceneBVH.objects.size()) {
+        std::vector<int> boxes;
+        for (size_t i = 0; i < scene.size(); i++)
+        {
+            if (scene.drawable[i])
+                boxes.push_back((int)i);
+        }
+        sceneBVH.build(sceneBounds, boxes);
+    }
+    else {
+        sceneBVH.refit(sceneBounds);
+    }
+}
+
+// what scene.model[node] is applied to: the unit cube spans [0, 0.5] on every axis, a mesh its own bounds
+// --------------------------------------------------------------------------------------------------------
+void localBounds(const SceneGraph& scene, int node, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+    if (scene.mesh[node] == -1) {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.5f);
+    }
+    else {
+        boundsMin = meshes[scene.mesh[node]].boundsMin;
+        boundsMax = meshes[scene.mesh[node]].boundsMax;
+    }
+}
+
+// test every box against the view frustum, one job per node range, then what is left against the occluders
+// -----------------------------------------------------------------------------------------------------------
+void cullScene(const SceneGraph& scene, const glm::mat4& viewProjection)
+{
+    if (!frustumCulling)
+        return;
+
+    viewFrustum.extract(viewProjection);
+    nodeVisible.resize(sceneBounds.centerX.size());
+    slotVisible.resize(staticBatch.boxCount());
+
+    int rangeCount = ((int)scene.size() + NODES_PER_JOB - 1) / NODES_PER_JOB;
+    if ((int)rangeOccluders.size() < rangeCount)
+        rangeOccluders.resize(rangeCount);
+    jobs.parallelFor(rangeCount, [&](int range, int) {
+        size_t begin = (size_t)range * NODES_PER_JOB;
+        sceneBounds.cull(viewFrustum, nodeVisible.data(), begin, std::min(sceneBounds.centerX.size(), begin + NODES_PER_JOB));
+
+        // visible occluder candidates, scored by their projected size
+        std::vector<std::pair<float, int> >& candidates = rangeOccluders[range];
+        candidates.clear();
+        if (!occlusionCulling)
+            return;
+        size_t end = std::min(scene.size(), begin + NODES_PER_JOB);
+        for (size_t i = begin; i < end; i++)
+        {
+            if (!nodeVisible[i] || !scene.drawable[i] || scene.mesh[i] != -1 || !isOccluder(scene.boxScale[i]))
+                continue;
+            float radius2 = sceneBounds.extentX[i] * sceneBounds.extentX[i] + sceneBounds.extentY[i] * sceneBounds.extentY[i]
+                          + sceneBounds.extentZ[i] * sceneBounds.extentZ[i];
+            float w = viewProjection[0][3] * sceneBounds.centerX[i] + viewProjection[1][3] * sceneBounds.centerY[i]
+                    + viewProjection[2][3] * sceneBounds.centerZ[i] + viewProjection[3][3];
+            candidates.push_back(std::make_pair(radius2 / std::max(w * w, 1e-4f), (int)i));
+        }
+    });
+
+    if (occlusionCulling) {
+        PROFILE_SCOPE("occluders");
+        occluderCandidates.clear();
+        for (int range = 0; range < rangeCount; range++)
+            occluderCandidates.insert(occluderCandidates.end(), rangeOccluders[range].begin(), rangeOccluders[range].end());
+        size_t occluderCount = std::min(occluderCandidates.size(), MAX_OCCLUDERS);
+        std::partial_sort(occluderCandidates.begin(), occluderCandidates.begin() + occluderCount, occluderCandidates.end(),
+                          std::greater<std::pair<float, int> >());
+
+        if (occlusionBuffer.width == 0)
+            occlusionBuffer.init(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+        occlusionBuffer.clear(viewProjection);
+        for (size_t i = 0; i < occluderCount; i++)
+            occlusionBuffer.rasterizeBox(scene.model[occluderCandidates[i].second], glm::vec3(0.0f), glm::vec3(0.5f));
+        occlusionBuffer.buildHierarchy();
+    }
+
+    rangeVisibleBoxes.assign(rangeCount, 0);
+    rangeCulledBoxes.assign(rangeCount, 0);
+    rangeOccludedBoxes.assign(rangeCount, 0);
+    jobs.parallelFor(rangeCount, [&](int range, int) {
+        size_t begin = (size_t)range * NODES_PER_JOB;
+        size_t end = std::min(scene.size(), begin + NODES_PER_JOB);
+        for (size_t i = begin; i < end; i++)
+        {
+            if (!scene.drawable[i])
+                continue;
+            if (nodeVisible[i] && occlusionCulling
+                && occlusionBuffer.occluded(glm::vec3(sceneBounds.centerX[i], sceneBounds.centerY[i], sceneBounds.centerZ[i]),
+                                            glm::vec3(sceneBounds.extentX[i], sceneBounds.extentY[i], sceneBounds.extentZ[i]))) {
+                nodeVisible[i] = 0;
+                rangeOccludedBoxes[range]++;
+            }
+            if (nodeVisible[i])
+                rangeVisibleBoxes[range]++;
+            else
+                rangeCulledBoxes[range]++;
+            // every node owns its own slot, so the ranges never write the same entry
+            if (staticBaking && staticSlot[i] != -1)
+                slotVisible[staticSlot[i]] = nodeVisible[i];
+        }
+    });
+
+    visibleBoxes = culledBoxes = occludedBoxes = 0;
+    for (int range = 0; range < rangeCount; range++)
+    {
+        visibleBoxes += rangeVisibleBoxes[range];
+        culledBoxes += rangeCulledBoxes[range];
+        occludedBoxes += rangeOccludedBoxes[range];
+    }
+}
+
+// big enough along two axes to hide things: walls, floors, roofs, table tops (scale of the unit cube)
+// ----------------------------------------------------------------------------------------------------
+bool isOccluder(const glm::vec3& boxScale)
+{
+    int bigAxes = 0;
+    for (int axis = 0; axis < 3; axis++)
+        bigAxes += std::fabs(boxScale[axis]) >= OCCLUDER_MIN_SCALE;
+    return bigAxes >= 2;
+}
+
+// the box under the cursor (window coordinates), or -1; the BVH narrows the candidates to a few
+// world-space boxes, which are then tested exactly in each box's own frame
+// ------------------------------------------------------------------------------------------------
+int pickObject(const SceneGraph& scene, double cursorX, double cursorY, const glm::mat4& viewProjection, const glm::vec3& eye)
+{
+    float ndcX = 2.0f * (float)cursorX / SCR_WIDTH - 1.0f;
+    float ndcY = 1.0f - 2.0f * (float)cursorY / SCR_HEIGHT;
+    glm::vec4 farPoint = glm::inverse(viewProjection) * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - eye);
+
+    return sceneBVH.raycast(eye, direction, [&](int node, float& distance) {
+        // the inverse model maps the ray onto the unit cube (or mesh bounds) without changing its parameter
+        glm::mat4 toLocal = glm::inverse(scene.model[node]);
+        glm::vec3 localOrigin = glm::vec3(toLocal * glm::vec4(eye, 1.0f));
+        glm::vec3 localDirection = glm::mat3(toLocal) * direction;
+        glm::vec3 boundsMin, boundsMax;
+        localBounds(scene, node, boundsMin, boundsMax);
+        distance = rayBoxDistance(localOrigin, 1.0f / localDirection, boundsMin, boundsMax);
+        return distance < FLT_MAX;
+    });
+}
+
+// per-frame input: toggles and the scroll/mouse motion of this frame, live or replayed
+// ---------------------------------------------------------------------------------------
+void processInput(const InputFrame& input)
+{
+    if (input.isDown(GLFW_KEY_ESCAPE))
+        quitRequested = true;
+
+    if (input.isDown(GLFW_KEY_0))
     {
         if (fanOn) {
             fanOn = false;
@@ -757,11 +1527,28 @@ void processInput(GLFWwindow* window)
             fanOn = true;
         }
     }
-    
+
+    if (input.isDown(GLFW_KEY_B)) {
+        birdEyeView = !birdEyeView;
+    }
+
+    if (input.scrollY != 0.0f)
+        basic_camera.ProcessMouseScroll(input.scrollY);
+    if (input.mouseDX != 0.0f || input.mouseDY != 0.0f)
+        basic_camera.ProcessMouseMovement(input.mouseDX, input.mouseDY);
+}
+
+// one simulation tick of dt seconds: move by the keys held this frame and spin the fan
+// --------------------------------------------------------------------------------------
+void simulate(const InputFrame& input, float dt)
+{
+    if (fanOn)
+        r += FAN_SPEED * dt;
+
     if (birdEyeView) {
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-            birdEyePosition.z -= birdEyeSpeed * deltaTime; // Move forward along Z
-            birdEyeTarget.z -= birdEyeSpeed * deltaTime;
+        if (input.isDown(GLFW_KEY_W)) {
+            birdEyePosition.z -= birdEyeSpeed * dt; // Move forward along Z
+            birdEyeTarget.z -= birdEyeSpeed * dt;
             if (birdEyePosition.z <= -1.0) {
                 birdEyePosition.z = -1.0;
             }
@@ -769,9 +1556,9 @@ void processInput(GLFWwindow* window)
                 birdEyeTarget.z = -4.0;
             }
         }
-        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-            birdEyePosition.z += birdEyeSpeed * deltaTime; // Move backward along Z
-            birdEyeTarget.z += birdEyeSpeed * deltaTime;
+        if (input.isDown(GLFW_KEY_S)) {
+            birdEyePosition.z += birdEyeSpeed * dt; // Move backward along Z
+            birdEyeTarget.z += birdEyeSpeed * dt;
             if (birdEyePosition.z >= 3.0) {
                 birdEyePosition.z = 3.0;
             }
@@ -781,88 +1568,102 @@ void processInput(GLFWwindow* window)
         }
     }
 
-    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) {
-        birdEyeView = !birdEyeView;
-    }
-
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) translate_Y += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) translate_Y -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) translate_X += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) translate_X -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) translate_Z += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) translate_Z -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) scale_X += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS) scale_X -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) scale_Y += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS) scale_Y -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) scale_Z += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) scale_Z -= 0.01;
-
-    if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
+    // these used to step once per rendered frame; the rates keep the old speed at 60 fps
+    if (input.isDown(GLFW_KEY_I)) translate_Y += 0.6 * dt;
+    if (input.isDown(GLFW_KEY_K)) translate_Y -= 0.6 * dt;
+    if (input.isDown(GLFW_KEY_L)) translate_X += 0.6 * dt;
+    if (input.isDown(GLFW_KEY_J)) translate_X -= 0.6 * dt;
+    if (input.isDown(GLFW_KEY_O)) translate_Z += 0.6 * dt;
+    if (input.isDown(GLFW_KEY_P)) translate_Z -= 0.6 * dt;
+    if (input.isDown(GLFW_KEY_C)) scale_X += 0.6 * dt;
+    if (input.isDown(GLFW_KEY_V)) scale_X -= 0.6 * dt;
+    if (input.isDown(GLFW_KEY_B)) scale_Y += 0.6 * dt;
+    if (input.isDown(GLFW_KEY_N)) scale_Y -= 0.6 * dt;
+    if (input.isDown(GLFW_KEY_M)) scale_Z += 0.6 * dt;
+    if (input.isDown(GLFW_KEY_U)) scale_Z -= 0.6 * dt;
+
+    if (input.isDown(GLFW_KEY_X))
     {
-        rotateAngle_X += 1;
+        rotateAngle_X += 60 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_Y))
     {
-        rotateAngle_Y += 1;
+        rotateAngle_Y += 60 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_Z))
     {
-        rotateAngle_Z += 1;
+        rotateAngle_Z += 60 * dt;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_H))
     {
-        eyeX += 2.5 * deltaTime;
+        eyeX += 2.5 * dt;
         basic_camera.eye = glm::vec3(eyeX, eyeY, eyeZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_F))
     {
-        eyeX -= 2.5 * deltaTime;
+        eyeX -= 2.5 * dt;
         basic_camera.eye = glm::vec3(eyeX, eyeY, eyeZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_T))
     {
-        eyeZ += 2.5 * deltaTime;
+        eyeZ += 2.5 * dt;
         basic_camera.eye = glm::vec3(eyeX, eyeY, eyeZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_G))
     {
-        eyeZ -= 2.5 * deltaTime;
+        eyeZ -= 2.5 * dt;
         basic_camera.eye = glm::vec3(eyeX, eyeY, eyeZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_Q))
     {
-        eyeY += 2.5 * deltaTime;
+        eyeY += 2.5 * dt;
         basic_camera.eye = glm::vec3(eyeX, eyeY, eyeZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_E))
     {
-        eyeY -= 2.5 * deltaTime;
+        eyeY -= 2.5 * dt;
         basic_camera.eye = glm::vec3(eyeX, eyeY, eyeZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_1))
     {
-        lookAtX += 2.5 * deltaTime;
+        lookAtX += 2.5 * dt;
         basic_camera.lookAt = glm::vec3(lookAtX, lookAtY, lookAtZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_2))
     {
-        lookAtX -= 2.5 * deltaTime;
+        lookAtX -= 2.5 * dt;
         basic_camera.lookAt = glm::vec3(lookAtX, lookAtY, lookAtZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_3))
     {
-        lookAtY += 2.5 * deltaTime;
+        lookAtY += 2.5 * dt;
         basic_camera.lookAt = glm::vec3(lookAtX, lookAtY, lookAtZ);
     }
-    if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
+    if (input.isDown(GLFW_KEY_4))
     {
-        lookAtY -= 2.5 * deltaTime;
+        lookAtY -= 2.5 * dt;
         basic_camera.lookAt = glm::vec3(lookAtX, lookAtY, lookAtZ);
     }
 }
 
+// snapshot of this frame's live input: held keys plus the scroll/mouse motion gathered by the callbacks
+// -----------------------------------------------------------------------------------------------------
+InputFrame sampleInput(GLFWwindow* window)
+{
+    InputFrame input;
+    for (int i = 0; i < RECORDED_KEY_COUNT; i++)
+    {
+        if (glfwGetKey(window, RECORDED_KEYS[i]) == GLFW_PRESS)
+            input.keys |= 1u << i;
+    }
+    input.scrollY = pendingScrollY;
+    input.mouseDX = pendingMouseDX;
+    input.mouseDY = pendingMouseDY;
+    pendingScrollY = pendingMouseDX = pendingMouseDY = 0.0f;
+    return input;
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -893,12 +1694,13 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    basic_camera.ProcessMouseMovement(xoffset, yoffset);
+    pendingMouseDX += xoffset;
+    pendingMouseDY += yoffset;
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    basic_camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    pendingScrollY += static_cast<float>(yoffset);
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+//
+//  memory_usage.h
+//  3D Object Drawing
+//
+//  Peak resident memory of the process, for the headless benchmark report
+//  (getrusage, GetProcessMemoryInfo on Windows).
+//
+
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// bytes; 0 when the platform cannot tell
+// ------------------------------------------------------------------------
+inline size_t peakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;             // bytes on macOS
+#else
+    return (size_t)usage.ru_maxrss * 1024;      // kilobytes on Linux
+#endif
+#endif
+}
+
+#endif
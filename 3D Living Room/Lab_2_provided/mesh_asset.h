@@ -0,0 +1,129 @@
+//
+//  mesh_asset.h
+//  3D Object Drawing
+//
+//  Loads a .mesh file (mesh_format.h) by memory-mapping it and handing the
+//  vertex and index blocks of the mapping straight to glBufferData, so the
+//  file is never read into a buffer of our own (the indices are only scanned
+//  once, in place, for values past the vertices). The quantized positions are
+//  fed to the shader as plain integers; dequantize maps them back onto the
+//  mesh bounds and goes in front of the model matrix. Normals are stored in
+//  mesh space, so for lighting they are scaled by the dequantization step,
+//  which cancels the inverse transpose of the scale inside model * dequantize.
+//
+
+#ifndef MESH_ASSET_H
+#define MESH_ASSET_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gl_state.h"
+#include "mapped_file.h"
+#include "mesh_format.h"
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// attribute location of the packed normal; 1 is the baked color and 2..6 the per-instance data
+const GLuint MESH_NORMAL_LOCATION = 7;
+// per-mesh normal scale, read from a one-element buffer with a divisor so every vertex sees the same value
+const GLuint MESH_NORMAL_SCALE_LOCATION = 8;
+
+class MeshAsset
+{
+public:
+    std::string path;
+    unsigned int VAO, VBO, EBO, normalScaleVBO;
+    GLsizei indexCount;
+    GLenum indexType;               // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    glm::vec3 boundsMin, boundsMax; // of the decoded positions
+    glm::mat4 dequantize;           // quantized grid -> mesh space
+    size_t gpuBytes;
+
+    MeshAsset() : VAO(0), VBO(0), EBO(0), normalScaleVBO(0), indexCount(0), indexType(GL_UNSIGNED_INT),
+                  boundsMin(0.0f), boundsMax(0.0f), dequantize(1.0f), gpuBytes(0) {}
+
+    // ------------------------------------------------------------------------
+    bool load(const char* filePath)
+    {
+        MappedFile file;
+        if (!file.open(filePath))
+        {
+            std::cout << "ERROR::MESH::FILE_NOT_SUCCESSFULLY_READ: " << filePath << std::endl;
+            return false;
+        }
+        if (file.size < sizeof(MeshFileHeader))
+        {
+            std::cout << "ERROR::MESH::INVALID_FILE: " << filePath << " (truncated file)" << std::endl;
+            return false;
+        }
+        MeshFileHeader header;
+        memcpy(&header, file.data, sizeof(header));
+        const char* problem = validateMeshHeader(header, file.size);
+        if (!problem)
+            problem = validateMeshIndices(header, file.data + header.indexOffset);
+        if (problem)
+        {
+            std::cout << "ERROR::MESH::INVALID_FILE: " << filePath << " (" << problem << ")" << std::endl;
+            return false;
+        }
+
+        path = filePath;
+        indexCount = (GLsizei)header.indexCount;
+        indexType = header.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        // files converted before obj2mesh padded flat axes have a zero extent there
+        padMeshBounds(header.boundsMin, header.boundsMax);
+        boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+        boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 step = (boundsMax - boundsMin) * (0.5f / (float)MESH_POSITION_RANGE);
+        dequantize = glm::scale(glm::translate(glm::mat4(1.0f), center), step);
+
+        size_t vertexBytes = (size_t)header.vertexCount * sizeof(PackedVertex);
+        size_t indexBytes = (size_t)header.indexCount * header.indexSize;
+        gpuBytes = vertexBytes + indexBytes;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        GLState::instance().bindVertexArray(VAO);
+
+        // the driver copies out of the mapping; the pages are only faulted in by that copy
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, file.data + header.vertexOffset, GL_STATIC_DRAW);
+        GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, file.data + header.indexOffset, GL_STATIC_DRAW);
+
+        // integer positions, converted to float as they are; dequantize does the scaling
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(PackedVertex), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(MESH_NORMAL_LOCATION, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+        glEnableVertexAttribArray(MESH_NORMAL_LOCATION);
+
+        glGenBuffers(1, &normalScaleVBO);
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, normalScaleVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3), &step[0], GL_STATIC_DRAW);
+        glVertexAttribPointer(MESH_NORMAL_SCALE_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glVertexAttribDivisor(MESH_NORMAL_SCALE_LOCATION, 1);
+        glEnableVertexAttribArray(MESH_NORMAL_SCALE_LOCATION);
+
+        GLState::instance().bindVertexArray(0);
+        return true;
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        GLState::instance().deleteVertexArray(VAO);
+        GLState::instance().deleteBuffer(VBO);
+        GLState::instance().deleteBuffer(EBO);
+        GLState::instance().deleteBuffer(normalScaleVBO);
+        VAO = VBO = EBO = normalScaleVBO = 0;
+        indexCount = 0;
+        gpuBytes = 0;
+    }
+};
+
+#endif
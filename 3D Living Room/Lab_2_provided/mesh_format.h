@@ -0,0 +1,165 @@
+//
+//  mesh_format.h
+//  3D Object Drawing
+//
+//  Binary mesh file (.mesh), written by tools/obj2mesh.cpp and mapped
+//  straight into GL buffers by mesh_asset.h. Little endian:
+//
+//    MeshFileHeader | vertices (PackedVertex[vertexCount]) | indices
+//
+//  Both blocks start on a 16-byte boundary. Positions are int16 on a grid
+//  spanning the mesh bounds, normals are packed 2_10_10_10 snorm, and the
+//  indices are 16-bit whenever the vertex count allows it, so a vertex is
+//  12 bytes instead of 24 (or 32 with a float normal).
+//
+//  Kept free of GL and glm so the converter builds on its own.
+//
+
+#ifndef MESH_FORMAT_H
+#define MESH_FORMAT_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+const char MESH_FILE_MAGIC[4] = { 'L', 'R', 'M', 'S' };
+const uint32_t MESH_FILE_VERSION = 1;
+const int32_t MESH_POSITION_RANGE = 32767;      // quantized positions span [-32767, 32767] on every axis
+
+struct MeshFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;         // 2 or 4 bytes
+    uint32_t vertexOffset;      // from the start of the file
+    uint32_t indexOffset;
+    uint32_t reserved;
+    float boundsMin[3];         // the quantization grid: -32767 maps to boundsMin, 32767 to boundsMax
+    float boundsMax[3];
+};
+
+struct PackedVertex
+{
+    int16_t position[3];
+    int16_t padding;
+    uint32_t normal;            // GL_INT_2_10_10_10_REV: x in bits 0..9, y in 10..19, z in 20..29
+};
+
+// round up to the 16-byte block alignment
+// ------------------------------------------------------------------------
+inline uint32_t alignMeshOffset(uint32_t offset)
+{
+    return (offset + 15u) & ~15u;
+}
+// unit vector to 10-bit snorm components
+// ------------------------------------------------------------------------
+inline uint32_t packMeshNormal(float x, float y, float z)
+{
+    float c[3] = { x, y, z };
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float v = c[i] < -1.0f ? -1.0f : (c[i] > 1.0f ? 1.0f : c[i]);
+        int32_t q = (int32_t)std::floor(v * 511.0f + 0.5f);
+        packed |= ((uint32_t)q & 0x3FFu) << (10 * i);
+    }
+    return packed;
+}
+// position component to the grid between lo and hi
+// ------------------------------------------------------------------------
+inline int16_t quantizeMeshPosition(float value, float lo, float hi)
+{
+    float half = (hi - lo) * 0.5f;
+    if (half <= 0.0f)
+        return 0;
+    float t = (value - (lo + half)) / half;
+    t = t < -1.0f ? -1.0f : (t > 1.0f ? 1.0f : t);
+    return (int16_t)std::floor(t * (float)MESH_POSITION_RANGE + 0.5f);
+}
+// give every axis of the quantization grid a minimum extent. A flat mesh (a rug, a picture, a tabletop
+// quad) has boundsMin == boundsMax on one axis, which would make the dequantization step and the normal
+// scale derived from it zero there, and the lit shaders divide by that scale. Returns true if it padded.
+// ------------------------------------------------------------------------
+inline bool padMeshBounds(float* boundsMin, float* boundsMax)
+{
+    // relative to the mesh's size and to its distance from the origin, so the padding survives rounding
+    float largest = 1.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        largest = std::fmax(largest, boundsMax[axis] - boundsMin[axis]);
+        largest = std::fmax(largest, std::fmax(std::fabs(boundsMin[axis]), std::fabs(boundsMax[axis])));
+    }
+    float minimumHalf = 1e-6f * largest;
+    bool padded = false;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if ((boundsMax[axis] - boundsMin[axis]) * 0.5f >= minimumHalf)
+            continue;
+        float center = (boundsMin[axis] + boundsMax[axis]) * 0.5f;
+        boundsMin[axis] = center - minimumHalf;
+        boundsMax[axis] = center + minimumHalf;
+        padded = true;
+    }
+    return padded;
+}
+// checks the header against the file before the blocks are touched: layout, sizes and bounds (the index
+// values are checked by validateMeshIndices); returns NULL or what is wrong
+// ------------------------------------------------------------------------
+inline const char* validateMeshHeader(const MeshFileHeader& header, uint64_t fileSize)
+{
+    if (memcmp(header.magic, MESH_FILE_MAGIC, 4) != 0)
+        return "not a mesh file";
+    if (header.version != MESH_FILE_VERSION)
+        return "unsupported version";
+    if (header.indexSize != 2 && header.indexSize != 4)
+        return "bad index size";
+    if (header.indexSize == 2 && header.vertexCount > 65536)
+        return "16-bit indices with more than 65536 vertices";
+    if (header.vertexOffset % 16 != 0 || header.indexOffset % 16 != 0)
+        return "misaligned block";
+    if (header.vertexOffset < sizeof(MeshFileHeader)
+        || (uint64_t)header.vertexOffset + (uint64_t)header.vertexCount * sizeof(PackedVertex) > header.indexOffset
+        || (uint64_t)header.indexOffset + (uint64_t)header.indexCount * header.indexSize > fileSize)
+        return "truncated file";
+    if (header.indexCount % 3 != 0)
+        return "index count is not a multiple of 3";
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (!std::isfinite(header.boundsMin[axis]) || !std::isfinite(header.boundsMax[axis])
+            || header.boundsMin[axis] > header.boundsMax[axis])
+            return "bad bounds";
+    }
+    return NULL;
+}
+// one read-only pass over the index block of a header that passed validateMeshHeader: every index
+// must name a vertex, or GL reads past the vertex buffer on contexts without robust access
+// ------------------------------------------------------------------------
+inline const char* validateMeshIndices(const MeshFileHeader& header, const unsigned char* indexBlock)
+{
+    uint32_t largest = 0;
+    if (header.indexSize == 2)
+    {
+        for (uint32_t i = 0; i < header.indexCount; i++)
+        {
+            uint16_t index;
+            memcpy(&index, indexBlock + (size_t)i * 2, 2);
+            largest = index > largest ? index : largest;
+        }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < header.indexCount; i++)
+        {
+            uint32_t index;
+            memcpy(&index, indexBlock + (size_t)i * 4, 4);
+            largest = index > largest ? index : largest;
+        }
+    }
+    if (header.indexCount > 0 && largest >= header.vertexCount)
+        return "index past the last vertex";
+    return NULL;
+}
+
+#endif
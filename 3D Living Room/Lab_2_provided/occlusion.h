@@ -0,0 +1,245 @@
+//
+//  occlusion.h
+//  3D Object Drawing
+//
+//  CPU occlusion culling. A few large boxes (walls, floors, roofs) are
+//  rasterized into a small depth buffer, which is then reduced into a
+//  hierarchical-Z chain where every texel holds the farthest depth of the
+//  four below it. A box is occluded when its nearest point lies behind the
+//  farthest occluder depth over the at most 2x2 texels of the first level
+//  its screen rectangle fits into.
+//
+//  The occluder raster is conservative so nothing visible is ever culled:
+//  a texel only takes a face's depth when the face covers all of it, and
+//  then the farthest depth the face reaches inside the texel.
+//
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+const float OCCLUSION_NEAR_W = 1e-4f;       // clip w below which a point counts as on the near plane
+const float OCCLUSION_DEPTH_BIAS = 1e-6f;
+
+class OcclusionBuffer
+{
+public:
+    int width, height;
+
+    OcclusionBuffer() : width(0), height(0), viewProjection(1.0f) {}
+
+    // ------------------------------------------------------------------------
+    void init(int bufferWidth, int bufferHeight)
+    {
+        width = bufferWidth;
+        height = bufferHeight;
+        levels.clear();
+        levelWidth.clear();
+        levelHeight.clear();
+        int w = width, h = height;
+        while (true)
+        {
+            levels.push_back(std::vector<float>((size_t)w * h, 1.0f));
+            levelWidth.push_back(w);
+            levelHeight.push_back(h);
+            if (w == 1 && h == 1)
+                break;
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+    }
+    // start a frame: everything at the far plane
+    // ------------------------------------------------------------------------
+    void clear(const glm::mat4& frameViewProjection)
+    {
+        viewProjection = frameViewProjection;
+        std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+    }
+    // the box [localMin, localMax] placed by model, as six quads
+    // ------------------------------------------------------------------------
+    void rasterizeBox(const glm::mat4& model, const glm::vec3& localMin, const glm::vec3& localMax)
+    {
+        glm::vec4 corners[8];
+        glm::mat4 toClip = viewProjection * model;
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec3 local((i & 1) ? localMax.x : localMin.x, (i & 2) ? localMax.y : localMin.y, (i & 4) ? localMax.z : localMin.z);
+            corners[i] = toClip * glm::vec4(local, 1.0f);
+        }
+        static const int faces[6][4] = {
+            { 0, 2, 6, 4 }, { 1, 5, 7, 3 },     // -x, +x
+            { 0, 4, 5, 1 }, { 2, 3, 7, 6 },     // -y, +y
+            { 0, 1, 3, 2 }, { 4, 6, 7, 5 },     // -z, +z
+        };
+        for (int f = 0; f < 6; f++)
+        {
+            glm::vec4 quad[4] = { corners[faces[f][0]], corners[faces[f][1]], corners[faces[f][2]], corners[faces[f][3]] };
+            rasterizeQuad(quad);
+        }
+    }
+    // reduce the rasterized level into the rest of the chain
+    // ------------------------------------------------------------------------
+    void buildHierarchy()
+    {
+        for (size_t level = 1; level < levels.size(); level++)
+        {
+            const std::vector<float>& below = levels[level - 1];
+            std::vector<float>& above = levels[level];
+            int belowWidth = levelWidth[level - 1], belowHeight = levelHeight[level - 1];
+            for (int y = 0; y < levelHeight[level]; y++)
+            {
+                int y0 = 2 * y, y1 = std::min(2 * y + 1, belowHeight - 1);
+                for (int x = 0; x < levelWidth[level]; x++)
+                {
+                    int x0 = 2 * x, x1 = std::min(2 * x + 1, belowWidth - 1);
+                    above[(size_t)y * levelWidth[level] + x] = std::max(
+                        std::max(below[(size_t)y0 * belowWidth + x0], below[(size_t)y0 * belowWidth + x1]),
+                        std::max(below[(size_t)y1 * belowWidth + x0], below[(size_t)y1 * belowWidth + x1]));
+                }
+            }
+        }
+    }
+    // is the world-space box center +- extent hidden behind the occluders? Read-only, safe from several threads
+    // ------------------------------------------------------------------------
+    bool occluded(const glm::vec3& center, const glm::vec3& extent) const
+    {
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec3 corner(center.x + ((i & 1) ? extent.x : -extent.x), center.y + ((i & 2) ? extent.y : -extent.y),
+                             center.z + ((i & 4) ? extent.z : -extent.z));
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            // a box reaching the near plane is in the viewer's face
+            if (clip.w <= OCCLUSION_NEAR_W)
+                return false;
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+            float y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+            minX = std::min(minX, x); maxX = std::max(maxX, x);
+            minY = std::min(minY, y); maxY = std::max(maxY, y);
+            nearest = std::min(nearest, clip.z / clip.w);
+        }
+        int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(width - 1, (int)std::floor(maxX));
+        int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(height - 1, (int)std::floor(maxY));
+        if (x0 > x1 || y0 > y1)
+            return false;       // off screen: the frustum test's business
+
+        // the first level where the rectangle spans at most 2x2 texels
+        size_t level = 0;
+        while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+            level++;
+        const std::vector<float>& depth = levels[level];
+        int w = levelWidth[level];
+        for (int y = y0 >> level; y <= (y1 >> level); y++)
+        {
+            for (int x = x0 >> level; x <= (x1 >> level); x++)
+            {
+                if (nearest <= depth[(size_t)y * w + x] + OCCLUSION_DEPTH_BIAS)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    glm::mat4 viewProjection;
+    std::vector<std::vector<float> > levels;    // NDC depth, level 0 at full occlusion resolution
+    std::vector<int> levelWidth, levelHeight;
+
+    struct ScreenVertex
+    {
+        float x, y, z;
+    };
+
+    void rasterizeQuad(const glm::vec4* quad)
+    {
+        // clip against the near plane (z >= -w); one plane turns a quad into at most five vertices
+        glm::vec4 clipped[5];
+        int count = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            const glm::vec4& a = quad[i];
+            const glm::vec4& b = quad[(i + 1) % 4];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0.0f)
+                clipped[count++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                clipped[count++] = a + (b - a) * (da / (da - db));
+        }
+        if (count < 3)
+            return;
+
+        ScreenVertex v[5];
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, farthest = -1e30f;
+        for (int i = 0; i < count; i++)
+        {
+            float w = std::max(clipped[i].w, OCCLUSION_NEAR_W);
+            v[i].x = (clipped[i].x / w * 0.5f + 0.5f) * width;
+            v[i].y = (clipped[i].y / w * 0.5f + 0.5f) * height;
+            v[i].z = clipped[i].z / w;
+            minX = std::min(minX, v[i].x); maxX = std::max(maxX, v[i].x);
+            minY = std::min(minY, v[i].y); maxY = std::max(maxY, v[i].y);
+            farthest = std::max(farthest, v[i].z);
+        }
+        int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(width - 1, (int)std::floor(maxX));
+        int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(height - 1, (int)std::floor(maxY));
+        if (x0 > x1 || y0 > y1)
+            return;
+
+        // depth plane z = z0 + dzdx * (x - x0') + dzdy * (y - y0'), from the widest corner of the polygon
+        float ax = v[1].x - v[0].x, ay = v[1].y - v[0].y, az = v[1].z - v[0].z;
+        float bx = v[2].x - v[0].x, by = v[2].y - v[0].y, bz = v[2].z - v[0].z;
+        for (int i = 3; i < count; i++)
+        {
+            float cx = v[i].x - v[0].x, cy = v[i].y - v[0].y;
+            if (std::fabs(ax * cy - ay * cx) > std::fabs(ax * by - ay * bx))
+            {
+                bx = cx; by = cy; bz = v[i].z - v[0].z;
+            }
+        }
+        float area = ax * by - ay * bx;
+        // edge-on: covers no texel completely
+        if (std::fabs(area) < 1e-6f)
+            return;
+        float dzdx = (az * by - bz * ay) / area;
+        float dzdy = (bz * ax - az * bx) / area;
+        float texelSlack = 0.5f * (std::fabs(dzdx) + std::fabs(dzdy));
+
+        // edge functions, signed so the inside is positive; a texel is covered when all its corners are
+        float edgeA[5], edgeB[5], edgeC[5], edgeSlack[5];
+        float orientation = area > 0.0f ? 1.0f : -1.0f;
+        for (int i = 0; i < count; i++)
+        {
+            const ScreenVertex& a = v[i];
+            const ScreenVertex& b = v[(i + 1) % count];
+            edgeA[i] = -(b.y - a.y) * orientation;
+            edgeB[i] = (b.x - a.x) * orientation;
+            edgeC[i] = -(edgeA[i] * a.x + edgeB[i] * a.y);
+            edgeSlack[i] = 0.5f * (std::fabs(edgeA[i]) + std::fabs(edgeB[i]));
+        }
+
+        std::vector<float>& depth = levels[0];
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = y + 0.5f;
+            for (int x = x0; x <= x1; x++)
+            {
+                float px = x + 0.5f;
+                bool covered = true;
+                for (int i = 0; i < count && covered; i++)
+                    covered = edgeA[i] * px + edgeB[i] * py + edgeC[i] - edgeSlack[i] >= 0.0f;
+                if (!covered)
+                    continue;
+                float z = std::min(farthest, v[0].z + dzdx * (px - v[0].x) + dzdy * (py - v[0].y) + texelSlack);
+                float& stored = depth[(size_t)y * width + x];
+                stored = std::min(stored, z);
+            }
+        }
+    }
+};
+
+#endif
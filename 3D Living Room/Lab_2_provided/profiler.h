@@ -0,0 +1,323 @@
+//
+//  profiler.h
+//  3D Object Drawing
+//
+//  Frame profiler: nestable CPU scope timers plus GL_TIME_ELAPSED queries
+//  around the render passes. Samples are aggregated per region into
+//  min/avg/p99 and can be written as a CSV summary or a Chrome trace
+//  (chrome://tracing, Perfetto) when the program exits.
+//
+//  Everything here is compiled out unless ENABLE_PROFILER is defined; the
+//  PROFILE_* macros then expand to nothing.
+//
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifdef ENABLE_PROFILER
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+class Profiler
+{
+public:
+    // one timed region of the frame, identified by its (string literal) name
+    struct Region
+    {
+        const char* name;
+        int depth;                          // nesting depth the region was first seen at
+        std::vector<double> cpuSamples;     // milliseconds
+        std::vector<double> gpuSamples;     // milliseconds
+        unsigned int queries[2];            // GL_TIME_ELAPSED pair, alternating per frame
+        bool pending[2];
+        double queryStart[2];               // CPU time the query began, places GPU work in the trace
+    };
+
+    // a single CPU or GPU interval, kept for the Chrome trace
+    struct Event
+    {
+        int region;
+        double start, duration;             // microseconds since the profiler started
+        bool gpu;
+    };
+
+    static const size_t MAX_EVENTS = 1 << 20;
+
+    static Profiler& instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // ------------------------------------------------------------------------
+    int region(const char* name)
+    {
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            if (strcmp(regions[i].name, name) == 0)
+                return (int)i;
+        }
+        Region r;
+        r.name = name;
+        r.depth = depth;
+        r.queries[0] = r.queries[1] = 0;
+        r.pending[0] = r.pending[1] = false;
+        r.queryStart[0] = r.queryStart[1] = 0.0;
+        regions.push_back(r);
+        return (int)regions.size() - 1;
+    }
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        frame++;
+    }
+    // ------------------------------------------------------------------------
+    double beginCpu()
+    {
+        depth++;
+        return now();
+    }
+    // ------------------------------------------------------------------------
+    void endCpu(int index, double start)
+    {
+        double end = now();
+        depth--;
+        // the first frame pays for driver and shader warm-up; keep it in the trace but out of the statistics
+        if (frame > 1)
+            regions[index].cpuSamples.push_back((end - start) / 1000.0);
+        addEvent(index, start, end - start, false);
+    }
+    // GL_TIME_ELAPSED queries cannot nest, so only the outermost GPU scope is measured
+    // ------------------------------------------------------------------------
+    bool beginGpu(int index)
+    {
+        if (gpuActive || frame <= 1)
+            return false;
+
+        Region& r = regions[index];
+        int slot = frame & 1;
+        if (r.queries[0] == 0)
+            glGenQueries(2, r.queries);
+        // this slot was issued two frames ago; collect it without waiting, drop it if it is still not ready
+        if (r.pending[slot])
+            collect(index, slot, false);
+
+        glBeginQuery(GL_TIME_ELAPSED, r.queries[slot]);
+        r.pending[slot] = true;
+        r.queryStart[slot] = now();
+        gpuActive = true;
+        return true;
+    }
+    // ------------------------------------------------------------------------
+    void endGpu()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuActive = false;
+    }
+    // wait for the queries still in flight and print min/avg/p99 per region
+    // ------------------------------------------------------------------------
+    void report()
+    {
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            for (int slot = 0; slot < 2; slot++)
+            {
+                if (regions[i].pending[slot])
+                    collect((int)i, slot, true);
+            }
+        }
+
+        std::cout << "profile over " << frame << " frames (ms)" << std::endl;
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            const Region& r = regions[i];
+            Stats cpu = stats(r.cpuSamples);
+            Stats gpu = stats(r.gpuSamples);
+            char line[256];
+            snprintf(line, sizeof(line), "  %*s%-*s cpu min %7.3f avg %7.3f p99 %7.3f",
+                     r.depth * 2, "", 20 - r.depth * 2, r.name, cpu.min, cpu.avg, cpu.p99);
+            std::cout << line;
+            if (!r.gpuSamples.empty())
+            {
+                snprintf(line, sizeof(line), " | gpu min %7.3f avg %7.3f p99 %7.3f", gpu.min, gpu.avg, gpu.p99);
+                std::cout << line;
+            }
+            std::cout << std::endl;
+        }
+        if (droppedQueries > 0)
+            std::cout << "  " << droppedQueries << " GPU samples were not ready in time and were dropped" << std::endl;
+    }
+    // a path ending in .json gets a Chrome trace, anything else a CSV summary
+    // ------------------------------------------------------------------------
+    bool write(const char* path) const
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER:: Could not open " << path << " for writing" << std::endl;
+            return false;
+        }
+        size_t length = strlen(path);
+        if (length >= 5 && strcmp(path + length - 5, ".json") == 0)
+            writeTrace(file);
+        else
+            writeCSV(file);
+        fclose(file);
+        std::cout << "profile written to " << path << std::endl;
+        return true;
+    }
+
+private:
+    struct Stats
+    {
+        double min, avg, p99, max;
+    };
+
+    std::vector<Region> regions;
+    std::vector<Event> events;
+    std::chrono::steady_clock::time_point epoch;
+    int frame;
+    int depth;
+    bool gpuActive;
+    unsigned int droppedQueries;
+
+    Profiler() : epoch(std::chrono::steady_clock::now()), frame(0), depth(0), gpuActive(false), droppedQueries(0) {}
+
+    double now() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void addEvent(int index, double start, double duration, bool gpu)
+    {
+        if (events.size() >= MAX_EVENTS)
+            return;
+        Event e = { index, start, duration, gpu };
+        events.push_back(e);
+    }
+
+    void collect(int index, int slot, bool wait)
+    {
+        Region& r = regions[index];
+        r.pending[slot] = false;
+        if (!wait)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(r.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                droppedQueries++;
+                return;
+            }
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(r.queries[slot], GL_QUERY_RESULT, &elapsed);
+        r.gpuSamples.push_back(elapsed / 1.0e6);
+        addEvent(index, r.queryStart[slot], elapsed / 1.0e3, true);
+    }
+
+    static Stats stats(std::vector<double> samples)
+    {
+        Stats s = { 0.0, 0.0, 0.0, 0.0 };
+        if (samples.empty())
+            return s;
+        std::sort(samples.begin(), samples.end());
+        double total = 0.0;
+        for (size_t i = 0; i < samples.size(); i++)
+            total += samples[i];
+        s.min = samples.front();
+        s.avg = total / samples.size();
+        s.p99 = samples[(samples.size() * 99) / 100];
+        s.max = samples.back();
+        return s;
+    }
+
+    void writeCSV(FILE* file) const
+    {
+        fprintf(file, "region,timer,samples,min_ms,avg_ms,p99_ms,max_ms\n");
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            const Region& r = regions[i];
+            for (int gpu = 0; gpu < 2; gpu++)
+            {
+                const std::vector<double>& samples = gpu ? r.gpuSamples : r.cpuSamples;
+                if (samples.empty())
+                    continue;
+                Stats s = stats(samples);
+                fprintf(file, "%s,%s,%u,%.4f,%.4f,%.4f,%.4f\n", r.name, gpu ? "gpu" : "cpu",
+                        (unsigned int)samples.size(), s.min, s.avg, s.p99, s.max);
+            }
+        }
+    }
+
+    // complete ("X") events; CPU scopes on thread 1, GPU passes on thread 2
+    void writeTrace(FILE* file) const
+    {
+        fprintf(file, "{\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            const Event& e = events[i];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    regions[e.region].name, e.gpu ? "gpu" : "cpu", e.start, e.duration, e.gpu ? 2 : 1);
+        }
+        fprintf(file, "\n]}\n");
+    }
+};
+
+// times the enclosing block on the CPU
+class ProfileCpuScope
+{
+public:
+    ProfileCpuScope(int regionIndex) : region(regionIndex), start(Profiler::instance().beginCpu()) {}
+    ~ProfileCpuScope() { Profiler::instance().endCpu(region, start); }
+
+private:
+    int region;
+    double start;
+};
+
+// times the enclosing block on the CPU and the GL commands it issues on the GPU
+class ProfileGpuScope
+{
+public:
+    ProfileGpuScope(int regionIndex) : cpu(regionIndex), timing(Profiler::instance().beginGpu(regionIndex)) {}
+    ~ProfileGpuScope()
+    {
+        if (timing)
+            Profiler::instance().endGpu();
+    }
+
+private:
+    ProfileCpuScope cpu;
+    bool timing;
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_FRAME() Profiler::instance().beginFrame()
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_JOIN(profileRegion, __LINE__) = Profiler::instance().region(name); \
+    ProfileCpuScope PROFILE_JOIN(profileScope, __LINE__)(PROFILE_JOIN(profileRegion, __LINE__))
+#define PROFILE_GPU_SCOPE(name) \
+    static const int PROFILE_JOIN(profileRegion, __LINE__) = Profiler::instance().region(name); \
+    ProfileGpuScope PROFILE_JOIN(profileScope, __LINE__)(PROFILE_JOIN(profileRegion, __LINE__))
+
+#else
+
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_GPU_SCOPE(name) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,193 @@
+//
+//  program_cache.h
+//  3D Object Drawing
+//
+//  On-disk cache of linked program binaries (glGetProgramBinary /
+//  glProgramBinary). Entries are keyed by a 64-bit FNV-1a hash of the shader
+//  sources, the defines and the driver's vendor/renderer/version strings, so
+//  a driver update or an edited shader simply misses. A binary the driver
+//  rejects is treated as a miss, its entry is deleted and the program is
+//  built from source. Entries are written to "<key>.tmp" and renamed into
+//  place, so a crash or a second instance never leaves a torn entry behind.
+//
+//  Entry file: "LRPB", uint32 binary format, uint32 length, binary bytes.
+//
+
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+class ProgramCache
+{
+public:
+    // where entries are stored; an empty directory disables the cache
+    // ------------------------------------------------------------------------
+    static std::string& directory()
+    {
+        static std::string path = "shader_cache";
+        return path;
+    }
+    // programs created from a cached binary / built from source since startup
+    // ------------------------------------------------------------------------
+    static unsigned int& hits()
+    {
+        static unsigned int count = 0;
+        return count;
+    }
+    static unsigned int& misses()
+    {
+        static unsigned int count = 0;
+        return count;
+    }
+    // ------------------------------------------------------------------------
+    static bool available()
+    {
+        if (directory().empty())
+            return false;
+        if (!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary)
+            return false;
+        // some drivers expose the entry points but no format to save in
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+    // ------------------------------------------------------------------------
+    static unsigned long long key(const std::string& vertexCode, const std::string& fragmentCode, const char* defines)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        hash = fnv1a(hash, vertexCode.data(), vertexCode.size());
+        hash = fnv1a(hash, "\0", 1);
+        hash = fnv1a(hash, fragmentCode.data(), fragmentCode.size());
+        hash = fnv1a(hash, "\0", 1);
+        if (defines)
+            hash = fnv1a(hash, defines, strlen(defines));
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (int i = 0; i < 3; i++)
+        {
+            const char* value = (const char*)glGetString(strings[i]);
+            hash = fnv1a(hash, "\0", 1);
+            if (value)
+                hash = fnv1a(hash, value, strlen(value));
+        }
+        return hash;
+    }
+    // load the entry for 'key' into program; true only if the driver accepted and linked it.
+    // An unreadable or rejected entry is deleted so the rebuilt program can replace it.
+    // ------------------------------------------------------------------------
+    static bool load(GLuint program, unsigned long long key)
+    {
+        std::string path = entryPath(key);
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+
+        char magic[4];
+        unsigned int format = 0, length = 0;
+        bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, "LRPB", 4) == 0
+            && fread(&format, sizeof(unsigned int), 1, file) == 1
+            && fread(&length, sizeof(unsigned int), 1, file) == 1 && length > 0;
+        std::vector<char> binary(ok ? length : 0);
+        if (ok)
+            ok = fread(&binary[0], 1, length, file) == length;
+        fclose(file);
+        if (!ok)
+        {
+            remove(path.c_str());
+            return false;
+        }
+
+        glProgramBinary(program, (GLenum)format, &binary[0], (GLsizei)length);
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE)
+        {
+            remove(path.c_str());
+            return false;
+        }
+        return true;
+    }
+    // write the binary of a freshly linked program; it must have been linked with
+    // GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+    // ------------------------------------------------------------------------
+    static bool store(GLuint program, unsigned long long key)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+        makeDirectory(directory());
+        std::string path = entryPath(key);
+        std::string temporaryPath = path + ".tmp";
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::PROGRAM_CACHE:: Could not open " << temporaryPath << " for writing" << std::endl;
+            return false;
+        }
+        unsigned int format32 = format, length32 = (unsigned int)length;
+        bool ok = fwrite("LRPB", 1, 4, file) == 4
+            && fwrite(&format32, sizeof(unsigned int), 1, file) == 1
+            && fwrite(&length32, sizeof(unsigned int), 1, file) == 1
+            && fwrite(&binary[0], 1, length, file) == (size_t)length;
+        ok = fclose(file) == 0 && ok;
+#if defined(_WIN32)
+        // rename() does not replace an existing file here
+        if (ok)
+            remove(path.c_str());
+#endif
+        if (!ok || rename(temporaryPath.c_str(), path.c_str()) != 0)
+        {
+            std::cout << "ERROR::PROGRAM_CACHE:: Could not write " << path << std::endl;
+            remove(temporaryPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static unsigned long long fnv1a(unsigned long long hash, const char* data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static std::string entryPath(unsigned long long key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", key);
+        return directory() + "/" + name;
+    }
+
+    static void makeDirectory(const std::string& path)
+    {
+#if defined(_WIN32)
+        _mkdir(path.c_str());
+#else
+        mkdir(path.c_str(), 0755);
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,190 @@
+//
+//  ring_buffer.h
+//  3D Object Drawing
+//
+//  Streaming buffer for data that is rewritten every frame (instance and
+//  draw records). With GL 4.4 / ARB_buffer_storage the buffer is mapped
+//  once, persistently and coherently, and split into FRAMES_IN_FLIGHT
+//  regions; each frame writes straight into the next region after waiting
+//  on the fence the GPU signals when it is done with that region's last
+//  draw. Anywhere else (the GL 3.3 context main() asks for) the frame is
+//  written to a CPU copy and uploaded by orphaning the buffer.
+//
+//  begin() a frame, write the returned memory, end() it, issue the draws
+//  that read it at offset(), then fence().
+//
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+
+#include <iostream>
+#include <vector>
+
+class RingBuffer
+{
+public:
+    static const int FRAMES_IN_FLIGHT = 3;
+
+    unsigned int buffer;
+    unsigned long long stalls;      // begin() calls that had to wait for the GPU to release a region
+
+    RingBuffer() : buffer(0), stalls(0), target(0), alignment(1), regionSize(0), region(0), persistent(false), mapped(NULL)
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+            fences[i] = 0;
+    }
+
+    // ------------------------------------------------------------------------
+    static bool persistentAvailable()
+    {
+        return GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+    }
+    // offsetAlignment is what the region offsets must be a multiple of (e.g. the storage buffer offset
+    // alignment); allowPersistent false always takes the orphaning path
+    // ------------------------------------------------------------------------
+    void init(GLenum bufferTarget, size_t offsetAlignment, bool allowPersistent)
+    {
+        target = bufferTarget;
+        alignment = offsetAlignment > 0 ? offsetAlignment : 1;
+        persistent = allowPersistent && persistentAvailable();
+    }
+    // ------------------------------------------------------------------------
+    bool isPersistent() const
+    {
+        return persistent;
+    }
+    // where this frame's data starts in buffer; valid from begin() to the next begin()
+    // ------------------------------------------------------------------------
+    size_t offset() const
+    {
+        return persistent ? region * regionSize : 0;
+    }
+    // memory for bytes of this frame's data; only write to it, mapped memory can be slow to read
+    // ------------------------------------------------------------------------
+    void* begin(size_t bytes)
+    {
+        if (bytes > regionSize)
+            grow(bytes);
+
+        if (!persistent)
+            return staging.data();
+
+        region = (region + 1) % FRAMES_IN_FLIGHT;
+        waitFor(region);
+        return mapped + offset();
+    }
+    // make the first bytes written since begin() visible to the GPU
+    // ------------------------------------------------------------------------
+    void end(size_t bytes)
+    {
+        // coherent mapping: the writes are already visible
+        if (persistent)
+            return;
+
+        GLState::instance().bindBuffer(target, buffer);
+        glBufferData(target, regionSize, NULL, GL_STREAM_DRAW);
+        glBufferSubData(target, 0, bytes, staging.data());
+    }
+    // call after the last draw that reads this frame's region
+    // ------------------------------------------------------------------------
+    void fence()
+    {
+        if (!persistent)
+            return;
+        if (fences[region])
+            glDeleteSync(fences[region]);
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        release();
+        staging.clear();
+        regionSize = 0;
+        region = 0;
+    }
+
+private:
+    GLenum target;
+    size_t alignment;
+    size_t regionSize;
+    size_t region;
+    bool persistent;
+    unsigned char* mapped;
+    GLsync fences[FRAMES_IN_FLIGHT];
+    std::vector<unsigned char> staging;     // orphaning path: the frame is built here and uploaded by end()
+
+    void waitFor(size_t index)
+    {
+        if (!fences[index])
+            return;
+        GLenum result = glClientWaitSync(fences[index], 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            stalls++;
+            do
+            {
+                result = glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fences[index]);
+        fences[index] = 0;
+    }
+
+    void release()
+    {
+        for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (mapped)
+        {
+            GLState::instance().bindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            mapped = NULL;
+        }
+        if (buffer)
+            GLState::instance().deleteBuffer(buffer);
+        buffer = 0;
+    }
+
+    // geometric growth; immutable storage cannot be resized, so the persistent buffer is replaced
+    // (GL keeps the old storage alive until the draws still reading it are done)
+    void grow(size_t bytes)
+    {
+        regionSize = (bytes * 2 + alignment - 1) / alignment * alignment;
+
+        if (!persistent)
+        {
+            if (!buffer)
+                glGenBuffers(1, &buffer);
+            staging.resize(regionSize);
+            return;
+        }
+
+        release();
+        region = 0;
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        GLState::instance().bindBuffer(target, buffer);
+        glBufferStorage(target, regionSize * FRAMES_IN_FLIGHT, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(target, 0, regionSize * FRAMES_IN_FLIGHT, flags);
+        if (!mapped)
+        {
+            std::cout << "ERROR::RING_BUFFER::MAP_FAILED, uploading with glBufferSubData instead" << std::endl;
+            persistent = false;
+            // immutable storage cannot be orphaned, start over with a plain buffer
+            release();
+            glGenBuffers(1, &buffer);
+            staging.resize(regionSize);
+        }
+    }
+};
+
+#endif
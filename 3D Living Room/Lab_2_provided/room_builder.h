@@ -0,0 +1,180 @@
+//
+//  room_builder.h
+//  3D Object Drawing
+//
+//  Builds the living room furniture as scene graph subtrees. The numbers are
+//  the same placements the scene used to draw by hand every frame.
+//  buildRoomGrid replicates the furniture into a grid of randomized rooms
+//  for scaling benchmarks.
+//
+
+#ifndef ROOM_BUILDER_H
+#define ROOM_BUILDER_H
+
+#include "scene_graph.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// floor, front wall, left wall, roof and whiteboard
+inline int buildRoomShell(SceneGraph& scene, int parentNode, const glm::vec3& origin)
+{
+    glm::vec4 floorColor(0.494f, 0.514f, 0.541f, 1.0f);
+    glm::vec4 wallColor(0.659f, 0.820f, 0.843f, 1.0f);
+
+    int room = scene.addGroup("room", parentNode, origin);
+    scene.addBox("floor", room, glm::vec3(-1.5f, -1.0f, -4.1f), glm::vec3(10.0f, -0.2f, 14.2f), floorColor);
+    scene.addBox("front wall", room, glm::vec3(-1.5f, -1.0f, -4.0f), glm::vec3(10.0f, 7.0f, -0.2f), wallColor);
+    scene.addBox("left wall", room, glm::vec3(-1.5f, -1.0f, -4.0f), glm::vec3(0.2f, 7.0f, 14.0f), wallColor);
+    scene.addBox("roof", room, glm::vec3(-1.5f, 2.5f, -4.1f), glm::vec3(10.0f, 0.2f, 14.2f), floorColor);
+    scene.addBox("whiteboard", room, glm::vec3(0.0f, 0.0f, -4.0f), glm::vec3(5.0f, 3.0f, 0.2f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    return room;
+}
+
+// seat, four legs and a backrest; the backrest runs along X (at the +Z edge) or along Z (at the -X edge)
+inline int buildChair(SceneGraph& scene, int parentNode, const std::string& name, const glm::vec3& position, bool backrestAlongX)
+{
+    glm::vec4 seatColor(0.455f, 0.235f, 0.102f, 1.0f);
+    glm::vec4 legColor(0.329f, 0.173f, 0.110f, 1.0f);
+    glm::vec3 legScale(0.2f, -1.0f, 0.2f);
+    glm::vec3 pillarScale(0.2f, 1.3f, 0.2f);
+    glm::vec3 lineScale = backrestAlongX ? glm::vec3(1.0f, 0.2f, 0.2f) : glm::vec3(0.2f, 0.2f, 1.0f);
+    // backrest pillars sit at the two ends of the back edge
+    glm::vec3 backEdge = backrestAlongX ? glm::vec3(0.0f, 0.0f, 0.4f) : glm::vec3(0.0f);
+    glm::vec3 alongBack = backrestAlongX ? glm::vec3(0.4f, 0.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 0.4f);
+
+    int chair = scene.addGroup(name, parentNode, position);
+    scene.addBox(name + " seat", chair, glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 1.0f), seatColor);
+    scene.addBox(name + " leg back left", chair, glm::vec3(0.0f, 0.0f, 0.0f), legScale, legColor);
+    scene.addBox(name + " leg front left", chair, glm::vec3(0.0f, 0.0f, 0.4f), legScale, legColor);
+    scene.addBox(name + " leg front right", chair, glm::vec3(0.4f, 0.0f, 0.4f), legScale, legColor);
+    scene.addBox(name + " leg back right", chair, glm::vec3(0.4f, 0.0f, 0.0f), legScale, legColor);
+    scene.addBox(name + " pillar left", chair, backEdge + glm::vec3(0.0f, 0.1f, 0.0f), pillarScale, legColor);
+    scene.addBox(name + " pillar right", chair, backEdge + alongBack + glm::vec3(0.0f, 0.1f, 0.0f), pillarScale, legColor);
+    scene.addBox(name + " upper line", chair, backEdge + glm::vec3(0.0f, 0.65f, 0.0f), lineScale, legColor);
+    scene.addBox(name + " upper mid line", chair, backEdge + glm::vec3(0.0f, 0.3f, 0.0f), lineScale, legColor);
+    return chair;
+}
+
+// table top on four legs with three chairs around it
+inline int buildTableChair(SceneGraph& scene, int parentNode, const glm::vec3& origin)
+{
+    glm::vec4 topColor(0.882f, 0.710f, 0.604f, 1.0f);
+    glm::vec4 legColor(0.647f, 0.408f, 0.294f, 1.0f);
+    glm::vec3 legScale(0.2f, -1.0f, 0.2f);
+
+    int set = scene.addGroup("table set", parentNode, origin);
+    int table = scene.addGroup("table", set, glm::vec3(0.0f, -0.5f, 0.0f));
+    scene.addBox("table top", table, glm::vec3(0.0f), glm::vec3(4.0f, 0.2f, 2.0f), topColor);
+    scene.addBox("table leg left back", table, glm::vec3(0.0f, 0.0f, 0.0f), legScale, legColor);
+    scene.addBox("table leg right back", table, glm::vec3(1.9f, 0.0f, 0.0f), legScale, legColor);
+    scene.addBox("table leg left front", table, glm::vec3(0.0f, 0.0f, 0.9f), legScale, legColor);
+    scene.addBox("table leg right front", table, glm::vec3(1.9f, 0.0f, 0.9f), legScale, legColor);
+
+    buildChair(scene, set, "chair 1", glm::vec3(0.25f, -0.5f, 1.15f), true);
+    buildChair(scene, set, "chair 2", glm::vec3(1.25f, -0.5f, 1.15f), true);
+    buildChair(scene, set, "chair 3", glm::vec3(-0.75f, -0.5f, 0.25f), false);
+    return set;
+}
+
+// ceiling fan hanging from a rod; returns the hub node, whose yaw spins the hub and the blades
+inline int buildFan(SceneGraph& scene, int parentNode, const glm::vec3& center)
+{
+    glm::vec4 black(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec4 white(1.0f, 1.0f, 1.0f, 1.0f);
+
+    int fan = scene.addGroup("fan", parentNode, center);
+    scene.addBox("fan rod", fan, glm::vec3(-0.05f, 0.5f, -0.05f), glm::vec3(0.2f, -1.0f, 0.2f), black);
+
+    int hub = scene.addGroup("fan hub", fan, glm::vec3(0.0f));
+    scene.setDynamic(hub);
+    scene.addBox("fan middle", hub, glm::vec3(-0.2f, 0.0f, -0.2f), glm::vec3(0.8f, -0.2f, 0.8f), black);
+    scene.addBox("fan propeller left", hub, glm::vec3(-0.2f, 0.0f, -0.1f), glm::vec3(-1.5f, -0.2f, 0.4f), white);
+    scene.addBox("fan propeller right", hub, glm::vec3(0.2f, 0.0f, -0.1f), glm::vec3(1.5f, -0.2f, 0.4f), white);
+    scene.addBox("fan propeller up", hub, glm::vec3(-0.1f, 0.0f, -0.2f), glm::vec3(0.4f, -0.2f, -1.5f), white);
+    scene.addBox("fan propeller down", hub, glm::vec3(-0.1f, 0.0f, 0.2f), glm::vec3(0.4f, -0.2f, 1.5f), white);
+    return hub;
+}
+
+// the whole living room: shell, table set and fan
+inline int buildLivingRoom(SceneGraph& scene, int parentNode, const glm::vec3& origin, int* fanHub)
+{
+    int room = buildRoomShell(scene, parentNode, origin);
+    buildTableChair(scene, room, glm::vec3(0.0f));
+    int hub = buildFan(scene, room, glm::vec3(1.0f, 2.0f, 0.05f));
+    if (fanHub)
+        *fanHub = hub;
+    return room;
+}
+
+// rooms are laid out on the floor's footprint plus a gap
+const float ROOM_SPACING_X = 10.5f;
+const float ROOM_SPACING_Z = 14.5f;
+
+// xorshift32: the same sequence on every platform and standard library, so a seed names one scene everywhere
+struct RoomRandom
+{
+    uint32_t state;
+
+    explicit RoomRandom(uint32_t seed) : state(seed ? seed : 0x9E3779B9u) {}
+
+    uint32_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    // in [0, count)
+    int below(int count)
+    {
+        return (int)(next() % (uint32_t)count);
+    }
+    float uniform(float lo, float hi)
+    {
+        return lo + (hi - lo) * (float)(next() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+// rows x columns rooms under one "rooms" group. Room (0, 0) is the living room as buildLivingRoom builds it;
+// every other room gets the same shell with 1-3 table sets at random spots and quarter turns and 1-2 fans,
+// about 90 nodes a room on average. The hubs of all fans are appended to fanHubs.
+inline int buildRoomGrid(SceneGraph& scene, int rows, int columns, uint32_t seed, std::vector<int>& fanHubs)
+{
+    RoomRandom random(seed);
+    int grid = scene.addGroup("rooms", -1, glm::vec3(0.0f));
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            glm::vec3 origin(column * ROOM_SPACING_X, 0.0f, row * ROOM_SPACING_Z);
+            if (row == 0 && column == 0)
+            {
+                int hub;
+                buildLivingRoom(scene, grid, origin, &hub);
+                fanHubs.push_back(hub);
+                continue;
+            }
+
+            int room = buildRoomShell(scene, grid, origin);
+            int sets = 1 + random.below(3);
+            for (int i = 0; i < sets; i++)
+            {
+                // a set reaches 4 units from its origin, so this keeps it inside the floor for any quarter turn
+                glm::vec3 position(random.uniform(2.7f, 4.5f), 0.0f, random.uniform(0.2f, 6.0f));
+                int set = buildTableChair(scene, room, position);
+                scene.setYaw(set, 90.0f * random.below(4));
+            }
+            int fans = 1 + random.below(2);
+            for (int i = 0; i < fans; i++)
+            {
+                glm::vec3 center(random.uniform(0.5f, 6.5f), 2.0f, random.uniform(-2.0f, 8.0f));
+                fanHubs.push_back(buildFan(scene, room, center));
+            }
+        }
+    }
+    return grid;
+}
+
+#endif
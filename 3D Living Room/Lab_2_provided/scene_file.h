@@ -0,0 +1,836 @@
+//
+//  scene_file.h
+//  3D Object Drawing
+//
+//  Scene description files: the room's groups, boxes and meshes as data
+//  instead of code. The text form (.scene) is for editing, one node per
+//  line, parents before their children:
+//
+//    group <name> <parent> <x> <y> <z>                  [yaw <deg>] [dynamic] [spin]
+//    box   <name> <parent> <ox> <oy> <oz> <sx> <sy> <sz> <r> <g> <b> [<a>] [at <x> <y> <z>] [yaw <deg>] [dynamic]
+//    mesh  <name> <parent> <file.mesh> <ox> ... <b> [<a>] [at ...] [yaw ...] [dynamic]
+//
+//  Names with spaces are quoted. The parent is "-" for a root, a name (the
+//  latest node so far with that name, so replicated subtrees can reuse their
+//  names) or @<line-index> for the n-th node of the file. "spin" marks the
+//  nodes the fan animation turns. '#' starts a comment.
+//
+//  The binary form (.sceneb) is a header, fixed-size records with resolved
+//  parent indices and a string table; it is used in place from the contents.
+//
+//  The first load parses the mapped file; reloads read it into a reused
+//  buffer instead, since the file is being edited and a mapping of a file
+//  truncated under it faults. Either way the size and modification stamp are
+//  compared before and after parsing, and a file that changed meanwhile is
+//  read again (or the load fails). Parsing never allocates: names and paths
+//  are views into the contents, numbers are parsed in place, and the record
+//  and name tables are reused across loads. reload() diffs a changed file
+//  against the live scene so only edited nodes are marked dirty.
+//
+
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "mapped_file.h"
+#include "scene_graph.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+const char SCENE_FILE_MAGIC[4] = { 'L', 'R', 'S', 'C' };
+const uint32_t SCENE_FILE_VERSION = 1;
+
+// characters of a file that is mapped elsewhere; not NUL-terminated
+struct StringView
+{
+    const char* data;
+    size_t size;
+
+    bool operator==(const std::string& other) const
+    {
+        return other.size() == size && memcmp(other.data(), data, size) == 0;
+    }
+    bool operator==(const StringView& other) const
+    {
+        return other.size == size && memcmp(other.data, data, size) == 0;
+    }
+    bool operator==(const char* other) const
+    {
+        return strlen(other) == size && memcmp(other, data, size) == 0;
+    }
+    std::string str() const
+    {
+        return std::string(data, size);
+    }
+};
+
+struct SceneRecord
+{
+    enum Kind
+    {
+        GROUP = 0,
+        BOX = 1,
+        MESH = 2
+    };
+
+    int kind;
+    int parent;             // record index, -1 for a root
+    StringView name;
+    StringView mesh;        // path of the .mesh file, MESH records only
+    glm::vec3 position;     // node translation (a group's position, "at" for boxes and meshes)
+    float yaw;
+    glm::vec3 offset, scale;
+    glm::vec4 color;
+    unsigned char dynamic, spin;
+};
+
+// .sceneb layout; the records follow the header, the strings follow the records
+struct SceneBinaryHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t stringBytes;
+};
+
+struct SceneBinaryRecord
+{
+    uint32_t kind;
+    int32_t parent;
+    uint32_t nameOffset, nameLength;    // into the string table
+    uint32_t meshOffset, meshLength;
+    float position[3];
+    float yaw;
+    float offset[3];
+    float scale[3];
+    float color[4];
+    uint32_t flags;                     // SCENE_FLAG_*
+};
+
+const uint32_t SCENE_FLAG_DYNAMIC = 1;
+const uint32_t SCENE_FLAG_SPIN = 2;
+
+class SceneFile
+{
+public:
+    // what reload() had to do
+    enum ReloadResult
+    {
+        RELOAD_FAILED,          // the file did not parse; the live scene is untouched
+        RELOAD_UPDATED,         // same nodes, edited properties applied in place
+        RELOAD_APPENDED,        // same nodes plus new ones at the end
+        RELOAD_REBUILD          // nodes were removed, reordered or changed kind; the caller rebuilds
+    };
+
+    std::string path;
+    std::vector<SceneRecord> records;   // views into the contents, valid until the next load()
+    size_t nodesChanged;                // by the last reload()
+
+    SceneFile() : nodesChanged(0), stamp(0), data(NULL), size(0) {}
+
+    // map (or, with mapped false, read) and parse the file: binary if it starts with the magic, text otherwise
+    // ------------------------------------------------------------------------
+    bool load(const char* filePath, bool mapped = true)
+    {
+        path = filePath;
+        records.clear();
+        for (int attempt = 0; attempt < LOAD_ATTEMPTS; attempt++)
+        {
+            long long stampBefore = 0, sizeBefore = 0;
+            bool exists = fileState(filePath, stampBefore, sizeBefore);
+            stamp = stampBefore;
+            if (!exists || !(mapped ? mapContents(filePath) : readContents(filePath, (uint64_t)sizeBefore)))
+            {
+                std::cout << "ERROR::SCENE::FILE_NOT_SUCCESSFULLY_READ: " << filePath << std::endl;
+                return false;
+            }
+            const char* text = (const char*)data;
+            bool ok = size >= sizeof(SceneBinaryHeader) && memcmp(text, SCENE_FILE_MAGIC, 4) == 0
+                    ? parseBinary() : parseText(text, text + size);
+
+            long long stampAfter = 0, sizeAfter = 0;
+            if (fileState(filePath, stampAfter, sizeAfter) && stampAfter == stampBefore
+                && sizeAfter == sizeBefore && (uint64_t)sizeBefore == size)
+            {
+                if (!ok)
+                    records.clear();
+                return ok;
+            }
+            // written to while we parsed: what we saw may be half old, half new
+            records.clear();
+        }
+        // no stamp, so the next changedOnDisk() tries again once the writer is done
+        stamp = 0;
+        std::cout << "ERROR::SCENE::FILE_CHANGED_WHILE_READING: " << filePath << std::endl;
+        return false;
+    }
+    // cheap enough to call every few frames
+    // ------------------------------------------------------------------------
+    bool changedOnDisk() const
+    {
+        return !path.empty() && modificationStamp(path.c_str()) != stamp;
+    }
+    // append a node per record under scene; resolveMesh(StringView path) returns a mesh index or -1, in
+    // which case the node is kept as an empty group. Spinning nodes are added to spinNodes.
+    // Returns the scene index of the first record's node.
+    // ------------------------------------------------------------------------
+    template <class MeshResolver>
+    int instantiate(SceneGraph& scene, MeshResolver resolveMesh, std::vector<int>& spinNodes, size_t firstRecord = 0, int base = -1) const
+    {
+        if (base == -1)
+            base = (int)scene.size() - (int)firstRecord;
+        for (size_t i = firstRecord; i < records.size(); i++)
+        {
+            const SceneRecord& record = records[i];
+            int parentNode = record.parent == -1 ? -1 : base + record.parent;
+            int meshIndex = record.kind == SceneRecord::MESH ? resolveMesh(record.mesh) : -1;
+            int node;
+            if (record.kind == SceneRecord::BOX)
+                node = scene.addBox(record.name.str(), parentNode, record.offset, record.scale, record.color);
+            else if (meshIndex != -1)
+                node = scene.addMesh(record.name.str(), parentNode, meshIndex, record.offset, record.scale, record.color);
+            else
+                node = scene.addGroup(record.name.str(), parentNode, glm::vec3(0.0f));
+            scene.setPosition(node, record.position);
+            scene.setYaw(node, record.yaw);
+            if (record.dynamic || record.spin)
+                scene.setDynamic(node);
+            if (record.spin)
+                spinNodes.push_back(node);
+        }
+        return base;
+    }
+    // re-read the file and bring the nodes made from it (scene[base .. base + nodeCount)) up to date. Nodes
+    // are matched by position in the file; properties are set through the scene graph's setters, which
+    // only mark what really changed, so the following update() and uploads touch just the edited nodes.
+    // Spinning nodes keep whatever yaw the animation gives them.
+    // ------------------------------------------------------------------------
+    template <class MeshResolver>
+    ReloadResult reload(SceneGraph& scene, int base, size_t& nodeCount, MeshResolver resolveMesh, std::vector<int>& spinNodes)
+    {
+        nodesChanged = 0;
+        std::string current = path;
+        if (!load(current.c_str(), false))
+            return RELOAD_FAILED;
+
+        std::vector<unsigned char> spinning(scene.size(), 0);
+        for (size_t i = 0; i < spinNodes.size(); i++)
+            spinning[spinNodes[i]] = 1;
+
+        size_t common = std::min(records.size(), nodeCount);
+        for (size_t i = 0; i < common; i++)
+        {
+            if (!sameStructure(records[i], scene, base, (int)i, spinning, resolveMesh))
+                return RELOAD_REBUILD;
+        }
+        if (records.size() < nodeCount)
+            return RELOAD_REBUILD;
+        // new nodes can only be appended while nothing else follows the file's nodes in the scene
+        if (records.size() > nodeCount && (size_t)base + nodeCount != scene.size())
+            return RELOAD_REBUILD;
+
+        for (size_t i = 0; i < common; i++)
+        {
+            const SceneRecord& record = records[i];
+            int node = base + (int)i;
+            bool edited = scene.position[node] != record.position || (!record.spin && scene.yaw[node] != record.yaw);
+            if (scene.drawable[node])
+                edited = edited || scene.boxOffset[node] != record.offset || scene.boxScale[node] != record.scale
+                      || scene.color[node] != record.color;
+            if (!edited)
+                continue;
+            nodesChanged++;
+            scene.setPosition(node, record.position);
+            if (!record.spin)
+                scene.setYaw(node, record.yaw);
+            if (scene.drawable[node])
+            {
+                scene.setBox(node, record.offset, record.scale);
+                scene.setColor(node, record.color);
+            }
+        }
+        if (records.size() == nodeCount)
+            return RELOAD_UPDATED;
+
+        nodesChanged += records.size() - nodeCount;
+        instantiate(scene, resolveMesh, spinNodes, nodeCount, base);
+        nodeCount = records.size();
+        return RELOAD_APPENDED;
+    }
+    // write scene[first .. first + count) as a .scene (text) or, for a .sceneb path, binary file.
+    // meshPaths maps mesh indices to files; spinNodes are written with the spin flag.
+    // ------------------------------------------------------------------------
+    static bool write(const char* filePath, const SceneGraph& scene, int first, size_t count,
+                      const std::vector<std::string>& meshPaths, const std::vector<int>& spinNodes)
+    {
+        std::vector<unsigned char> spin(scene.size(), 0);
+        for (size_t i = 0; i < spinNodes.size(); i++)
+            spin[spinNodes[i]] = 1;
+
+        size_t length = strlen(filePath);
+        bool binary = length > 7 && strcmp(filePath + length - 7, ".sceneb") == 0;
+        std::ofstream out(filePath, binary ? std::ios::binary : std::ios::out);
+        if (!out)
+        {
+            std::cout << "ERROR::SCENE::FILE_NOT_SUCCESSFULLY_WRITTEN: " << filePath << std::endl;
+            return false;
+        }
+        if (binary)
+            writeBinary(out, scene, first, count, meshPaths, spin);
+        else
+            writeText(out, scene, first, count, meshPaths, spin);
+        return (bool)out;
+    }
+
+private:
+    // a file still changing after this many reads fails to load
+    static const int LOAD_ATTEMPTS = 3;
+
+    MappedFile file;
+    std::vector<unsigned char> buffer;  // contents of reloads, reused
+    long long stamp;
+    const unsigned char* data;          // the file's contents: the mapping or the buffer
+    uint64_t size;
+    std::vector<int> nameTable;         // open addressing: record index + 1, 0 = empty
+
+    // ------------------------------------------------------------------------
+    bool mapContents(const char* filePath)
+    {
+        data = NULL;
+        size = 0;
+        if (!file.open(filePath))
+            return false;
+        data = file.data;
+        size = file.size;
+        return true;
+    }
+    // read the file into the reused buffer; the mapping of an earlier load is released. A file that
+    // shrank since it was measured comes back short and one that grew has a new stamp; load() checks both.
+    // ------------------------------------------------------------------------
+    bool readContents(const char* filePath, uint64_t expectedSize)
+    {
+        file.close();
+        data = NULL;
+        size = 0;
+        if (expectedSize == 0)
+            return false;
+        FILE* in = fopen(filePath, "rb");
+        if (!in)
+            return false;
+        buffer.resize((size_t)expectedSize);
+        size_t count = fread(&buffer[0], 1, buffer.size(), in);
+        bool ok = !ferror(in);
+        fclose(in);
+        if (!ok)
+            return false;
+        data = &buffer[0];
+        size = count;
+        return true;
+    }
+
+    // modification time (ns where available) and size; false if the file does not exist
+    // ------------------------------------------------------------------------
+    static bool fileState(const char* filePath, long long& fileStamp, long long& fileSize)
+    {
+        struct stat info;
+        fileStamp = 0;
+        fileSize = 0;
+        if (stat(filePath, &info) != 0)
+            return false;
+#if defined(__linux__)
+        fileStamp = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec + (long long)info.st_size * 31;
+#else
+        fileStamp = (long long)info.st_mtime * 1000000000LL + (long long)info.st_size * 31;
+#endif
+        fileSize = (long long)info.st_size;
+        return true;
+    }
+    static long long modificationStamp(const char* filePath)
+    {
+        long long fileStamp, fileSize;
+        fileState(filePath, fileStamp, fileSize);
+        return fileStamp;
+    }
+
+    template <class MeshResolver>
+    static bool sameStructure(const SceneRecord& record, const SceneGraph& scene, int base, int index,
+                              const std::vector<unsigned char>& spinning, MeshResolver& resolveMesh)
+    {
+        int node = base + index;
+        int expectedParent = record.parent == -1 ? -1 : base + record.parent;
+        if (scene.parent[node] != expectedParent || !(record.name == scene.names[node]))
+            return false;
+        bool dynamic = record.dynamic || record.spin || (expectedParent != -1 && scene.dynamic[expectedParent]);
+        if (dynamic != (scene.dynamic[node] != 0) || (record.spin != 0) != (spinning[node] != 0))
+            return false;
+        if (record.kind == SceneRecord::BOX)
+            return scene.drawable[node] && scene.mesh[node] == -1;
+        if (record.kind == SceneRecord::MESH)
+        {
+            int meshIndex = resolveMesh(record.mesh);
+            return meshIndex == -1 ? !scene.drawable[node] : scene.mesh[node] == meshIndex;
+        }
+        return !scene.drawable[node];
+    }
+
+    // ------------------------------------------------------------------------
+    // text
+    // ------------------------------------------------------------------------
+
+    // one line at a time; tokens are views into the line
+    struct Cursor
+    {
+        const char* p;
+        const char* end;
+        int line;
+    };
+
+    static void skipBlanks(Cursor& c)
+    {
+        while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\r'))
+            c.p++;
+        // a comment runs to the end of the line
+        if (c.p < c.end && *c.p == '#')
+        {
+            while (c.p < c.end && *c.p != '\n')
+                c.p++;
+        }
+    }
+    // next token on the current line; false at the end of the line
+    static bool token(Cursor& c, StringView& out)
+    {
+        skipBlanks(c);
+        if (c.p >= c.end || *c.p == '\n')
+            return false;
+        if (*c.p == '"')
+        {
+            const char* start = ++c.p;
+            while (c.p < c.end && *c.p != '"' && *c.p != '\n')
+                c.p++;
+            if (c.p >= c.end || *c.p != '"')
+                return false;
+            out.data = start;
+            out.size = (size_t)(c.p - start);
+            c.p++;
+            return true;
+        }
+        const char* start = c.p;
+        while (c.p < c.end && *c.p != ' ' && *c.p != '\t' && *c.p != '\r' && *c.p != '\n')
+            c.p++;
+        out.data = start;
+        out.size = (size_t)(c.p - start);
+        return true;
+    }
+    // decimal number with optional sign, fraction and exponent, without strtof (which needs a terminator
+    // and depends on the locale)
+    static bool number(Cursor& c, float& value)
+    {
+        StringView t;
+        if (!token(c, t))
+            return false;
+        const char* p = t.data;
+        const char* end = t.data + t.size;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+        uint64_t mantissa = 0;
+        int exponent = 0, digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+        {
+            if (mantissa < 100000000000000000ULL)
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            else
+                exponent++;
+        }
+        if (p < end && *p == '.')
+        {
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+            {
+                if (mantissa < 100000000000000000ULL)
+                {
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                    exponent--;
+                }
+            }
+        }
+        if (digits == 0)
+            return false;
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                negativeExponent = *p++ == '-';
+            int e = 0;
+            if (p >= end || *p < '0' || *p > '9')
+                return false;
+            for (; p < end && *p >= '0' && *p <= '9'; p++)
+                e = std::min(e * 10 + (*p - '0'), 1000);
+            exponent += negativeExponent ? -e : e;
+        }
+        if (p != end)
+            return false;
+
+        // exact in double for the short literals a scene holds, so the float rounds the same as a literal would
+        double result = (double)mantissa;
+        double scale = 1.0;
+        for (int i = 0; i < (exponent < 0 ? -exponent : exponent) && i < 400; i++)
+            scale *= 10.0;
+        result = exponent < 0 ? result / scale : result * scale;
+        value = (float)(negative ? -result : result);
+        return true;
+    }
+    static bool vec3(Cursor& c, glm::vec3& v)
+    {
+        return number(c, v.x) && number(c, v.y) && number(c, v.z);
+    }
+
+    static uint32_t hashName(const StringView& name)
+    {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < name.size; i++)
+            h = (h ^ (unsigned char)name.data[i]) * 16777619u;
+        return h;
+    }
+    // later records with the same name replace earlier ones, so a name refers to the latest node so far
+    void rememberName(int index)
+    {
+        size_t mask = nameTable.size() - 1;
+        const StringView& name = records[index].name;
+        for (size_t slot = hashName(name) & mask; ; slot = (slot + 1) & mask)
+        {
+            if (nameTable[slot] == 0 || records[nameTable[slot] - 1].name == name)
+            {
+                nameTable[slot] = index + 1;
+                return;
+            }
+        }
+    }
+    int findName(const StringView& name) const
+    {
+        size_t mask = nameTable.size() - 1;
+        for (size_t slot = hashName(name) & mask; nameTable[slot] != 0; slot = (slot + 1) & mask)
+        {
+            if (records[nameTable[slot] - 1].name == name)
+                return nameTable[slot] - 1;
+        }
+        return -1;
+    }
+
+    bool fail(const Cursor& c, const char* what)
+    {
+        std::cout << "ERROR::SCENE::PARSE_ERROR: " << path << ":" << c.line << ": " << what << std::endl;
+        return false;
+    }
+
+    bool parseText(const char* begin, const char* end)
+    {
+        // one record per line at most; sizing the tables up front keeps the parse itself allocation free
+        size_t lines = 1;
+        for (const char* p = begin; (p = (const char*)memchr(p, '\n', (size_t)(end - p))) != NULL; p++)
+            lines++;
+        records.reserve(lines);
+        size_t tableSize = 16;
+        while (tableSize < lines * 2)
+            tableSize *= 2;
+        nameTable.assign(tableSize, 0);
+
+        Cursor c = { begin, end, 1 };
+        while (c.p < c.end)
+        {
+            StringView keyword;
+            if (token(c, keyword))
+            {
+                SceneRecord record;
+                record.parent = -1;
+                record.mesh.data = NULL;
+                record.mesh.size = 0;
+                record.position = glm::vec3(0.0f);
+                record.yaw = 0.0f;
+                record.offset = glm::vec3(0.0f);
+                record.scale = glm::vec3(0.0f);
+                record.color = glm::vec4(0.0f);
+                record.dynamic = record.spin = 0;
+
+                StringView parentName;
+                if (keyword == "group")
+                    record.kind = SceneRecord::GROUP;
+                else if (keyword == "box")
+                    record.kind = SceneRecord::BOX;
+                else if (keyword == "mesh")
+                    record.kind = SceneRecord::MESH;
+                else
+                    return fail(c, "unknown keyword");
+                if (!token(c, record.name) || !token(c, parentName))
+                    return fail(c, "expected a name and a parent");
+                if (record.kind == SceneRecord::MESH && !token(c, record.mesh))
+                    return fail(c, "expected a mesh file");
+
+                if (record.kind == SceneRecord::GROUP)
+                {
+                    if (!vec3(c, record.position))
+                        return fail(c, "expected a position");
+                }
+                else
+                {
+                    if (!vec3(c, record.offset) || !vec3(c, record.scale) || !number(c, record.color.x)
+                        || !number(c, record.color.y) || !number(c, record.color.z))
+                        return fail(c, "expected offset, scale and color");
+                    record.color.w = 1.0f;
+                    // optional alpha
+                    Cursor peek = c;
+                    float alpha;
+                    if (number(peek, alpha))
+                    {
+                        record.color.w = alpha;
+                        c = peek;
+                    }
+                }
+
+                StringView attribute;
+                while (token(c, attribute))
+                {
+                    if (attribute == "yaw")
+                    {
+                        if (!number(c, record.yaw))
+                            return fail(c, "expected degrees after yaw");
+                    }
+                    else if (attribute == "at" && record.kind != SceneRecord::GROUP)
+                    {
+                        if (!vec3(c, record.position))
+                            return fail(c, "expected a position after at");
+                    }
+                    else if (attribute == "dynamic")
+                        record.dynamic = 1;
+                    else if (attribute == "spin")
+                        record.spin = 1;
+                    else
+                        return fail(c, "unknown attribute");
+                }
+
+                if (parentName.size == 1 && parentName.data[0] == '-')
+                    record.parent = -1;
+                else if (parentName.size > 1 && parentName.data[0] == '@')
+                {
+                    int index = 0;
+                    for (size_t i = 1; i < parentName.size; i++)
+                    {
+                        if (parentName.data[i] < '0' || parentName.data[i] > '9')
+                            return fail(c, "bad parent index");
+                        index = index * 10 + (parentName.data[i] - '0');
+                        if (index >= (int)records.size())
+                            return fail(c, "parent index does not refer to an earlier node");
+                    }
+                    record.parent = index;
+                }
+                else
+                {
+                    record.parent = findName(parentName);
+                    if (record.parent == -1)
+                        return fail(c, "unknown parent");
+                }
+
+                records.push_back(record);
+                rememberName((int)records.size() - 1);
+            }
+            // the rest of the line has been consumed; step over the newline
+            if (c.p < c.end && *c.p == '\n')
+            {
+                c.p++;
+                c.line++;
+            }
+        }
+        return true;
+    }
+
+    static void writeNumber(std::ostream& out, float value)
+    {
+        // shortest form that reads back as the same float
+        char text[32];
+        for (int precision = 6; precision <= 9; precision++)
+        {
+            snprintf(text, sizeof(text), "%.*g", precision, value);
+            if ((float)atof(text) == value)
+                break;
+        }
+        out << text;
+    }
+    static void writeVec3(std::ostream& out, const glm::vec3& v)
+    {
+        out << ' ';
+        writeNumber(out, v.x);
+        out << ' ';
+        writeNumber(out, v.y);
+        out << ' ';
+        writeNumber(out, v.z);
+    }
+
+    static void writeText(std::ostream& out, const SceneGraph& scene, int first, size_t count,
+                          const std::vector<std::string>& meshPaths, const std::vector<unsigned char>& spin)
+    {
+        out << "# kind name parent ... see scene_file.h\n";
+        // latest node written under each name, to know when a parent has to be referenced by index
+        std::unordered_map<std::string, int> latest;
+        for (size_t i = 0; i < count; i++)
+        {
+            int node = first + (int)i;
+            int parentNode = scene.parent[node];
+            bool isMesh = scene.drawable[node] && scene.mesh[node] != -1;
+            out << (!scene.drawable[node] ? "group" : (isMesh ? "mesh" : "box")) << " \"" << scene.names[node] << "\" ";
+
+            if (parentNode == -1 || parentNode < first)
+                out << '-';
+            else
+            {
+                // the name resolves to the latest node with it; use the index when that is not the parent
+                std::unordered_map<std::string, int>::const_iterator resolved = latest.find(scene.names[parentNode]);
+                if (resolved != latest.end() && resolved->second == parentNode)
+                    out << '"' << scene.names[parentNode] << '"';
+                else
+                    out << '@' << parentNode - first;
+            }
+
+            if (!scene.drawable[node])
+                writeVec3(out, scene.position[node]);
+            else
+            {
+                if (isMesh)
+                    out << " \"" << meshPaths[scene.mesh[node]] << '"';
+                writeVec3(out, scene.boxOffset[node]);
+                writeVec3(out, scene.boxScale[node]);
+                writeVec3(out, glm::vec3(scene.color[node]));
+                if (scene.color[node].w != 1.0f)
+                {
+                    out << ' ';
+                    writeNumber(out, scene.color[node].w);
+                }
+                if (scene.position[node] != glm::vec3(0.0f))
+                {
+                    out << " at";
+                    writeVec3(out, scene.position[node]);
+                }
+            }
+            if (scene.yaw[node] != 0.0f && !spin[node])
+            {
+                out << " yaw ";
+                writeNumber(out, scene.yaw[node]);
+            }
+            if (spin[node])
+                out << " spin";
+            else if (scene.dynamic[node] && (parentNode == -1 || !scene.dynamic[parentNode]))
+                out << " dynamic";
+            out << '\n';
+
+            latest[scene.names[node]] = node;
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // binary
+    // ------------------------------------------------------------------------
+
+    bool parseBinary()
+    {
+        SceneBinaryHeader header;
+        memcpy(&header, data, sizeof(header));
+        uint64_t recordsEnd = sizeof(SceneBinaryHeader) + (uint64_t)header.recordCount * sizeof(SceneBinaryRecord);
+        if (header.version != SCENE_FILE_VERSION || recordsEnd + header.stringBytes > size)
+        {
+            std::cout << "ERROR::SCENE::INVALID_FILE: " << path << std::endl;
+            return false;
+        }
+        const SceneBinaryRecord* in = (const SceneBinaryRecord*)(data + sizeof(SceneBinaryHeader));
+        const char* strings = (const char*)data + recordsEnd;
+
+        records.resize(header.recordCount);
+        for (uint32_t i = 0; i < header.recordCount; i++)
+        {
+            const SceneBinaryRecord& r = in[i];
+            if (r.kind > SceneRecord::MESH || r.parent < -1 || r.parent >= (int32_t)i
+                || (uint64_t)r.nameOffset + r.nameLength > header.stringBytes
+                || (uint64_t)r.meshOffset + r.meshLength > header.stringBytes)
+            {
+                std::cout << "ERROR::SCENE::INVALID_FILE: " << path << " (record " << i << ")" << std::endl;
+                return false;
+            }
+            SceneRecord& record = records[i];
+            record.kind = (int)r.kind;
+            record.parent = r.parent;
+            record.name.data = strings + r.nameOffset;
+            record.name.size = r.nameLength;
+            record.mesh.data = strings + r.meshOffset;
+            record.mesh.size = r.meshLength;
+            record.position = glm::vec3(r.position[0], r.position[1], r.position[2]);
+            record.yaw = r.yaw;
+            record.offset = glm::vec3(r.offset[0], r.offset[1], r.offset[2]);
+            record.scale = glm::vec3(r.scale[0], r.scale[1], r.scale[2]);
+            record.color = glm::vec4(r.color[0], r.color[1], r.color[2], r.color[3]);
+            record.dynamic = (r.flags & SCENE_FLAG_DYNAMIC) ? 1 : 0;
+            record.spin = (r.flags & SCENE_FLAG_SPIN) ? 1 : 0;
+        }
+        return true;
+    }
+
+    static void writeBinary(std::ostream& out, const SceneGraph& scene, int first, size_t count,
+                            const std::vector<std::string>& meshPaths, const std::vector<unsigned char>& spin)
+    {
+        std::vector<SceneBinaryRecord> binaryRecords(count);
+        std::string strings;
+        for (size_t i = 0; i < count; i++)
+        {
+            int node = first + (int)i;
+            SceneBinaryRecord& r = binaryRecords[i];
+            memset(&r, 0, sizeof(r));
+            bool isMesh = scene.drawable[node] && scene.mesh[node] != -1;
+            r.kind = !scene.drawable[node] ? SceneRecord::GROUP : (isMesh ? SceneRecord::MESH : SceneRecord::BOX);
+            r.parent = scene.parent[node] < first ? -1 : scene.parent[node] - first;
+            r.nameOffset = (uint32_t)strings.size();
+            r.nameLength = (uint32_t)scene.names[node].size();
+            strings += scene.names[node];
+            if (isMesh)
+            {
+                const std::string& meshPath = meshPaths[scene.mesh[node]];
+                r.meshOffset = (uint32_t)strings.size();
+                r.meshLength = (uint32_t)meshPath.size();
+                strings += meshPath;
+            }
+            for (int axis = 0; axis < 3; axis++)
+            {
+                r.position[axis] = scene.position[node][axis];
+                r.offset[axis] = scene.boxOffset[node][axis];
+                r.scale[axis] = scene.boxScale[node][axis];
+            }
+            r.yaw = spin[node] ? 0.0f : scene.yaw[node];
+            for (int channel = 0; channel < 4; channel++)
+                r.color[channel] = scene.color[node][channel];
+            if (spin[node])
+                r.flags |= SCENE_FLAG_SPIN;
+            else if (scene.dynamic[node] && (scene.parent[node] == -1 || !scene.dynamic[scene.parent[node]]))
+                r.flags |= SCENE_FLAG_DYNAMIC;
+        }
+
+        SceneBinaryHeader header;
+        memcpy(header.magic, SCENE_FILE_MAGIC, 4);
+        header.version = SCENE_FILE_VERSION;
+        header.recordCount = (uint32_t)count;
+        header.stringBytes = (uint32_t)strings.size();
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)binaryRecords.data(), (std::streamsize)(binaryRecords.size() * sizeof(SceneBinaryRecord)));
+        out.write(strings.data(), (std::streamsize)strings.size());
+    }
+};
+
+#endif
@@ -0,0 +1,352 @@
+//
+//  scene_graph.h
+//  3D Object Drawing
+//
+//  Parent/child scene nodes stored as structure-of-arrays. Each node has a
+//  local translation + yaw relative to its parent and optionally a box (the
+//  shared unit cube, or a loaded mesh, placed by an offset and a scale). World matrices are only
+//  recomputed for subtrees that were changed since the last update(): the
+//  traversal only lists the dirty nodes parent-first, and one call of the
+//  column kernel (transform_kernel.h) composes their matrices. The job system
+//  overload spreads independent subtrees across threads.
+//
+
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include "job_system.h"
+#include "transform_kernel.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+class SceneGraph
+{
+public:
+    // hierarchy
+    std::vector<std::string> names;
+    std::vector<int> parent;            // -1 for root nodes
+    std::vector<int> firstChild;
+    std::vector<int> nextSibling;
+
+    // local transform
+    std::vector<glm::vec3> position;    // translation relative to the parent frame
+    std::vector<float> yaw;             // rotation about Y in degrees, applied after the translation
+
+    // box drawn with the unit cube; group nodes have drawable == 0
+    std::vector<glm::vec3> boxOffset;   // corner of the box in the node's own frame
+    std::vector<glm::vec3> boxScale;
+    std::vector<glm::vec4> color;
+    std::vector<unsigned char> drawable;
+    std::vector<int> mesh;              // index into the renderer's mesh list, -1 for the unit cube
+    // set for nodes expected to move every frame (and everything below them); the rest is static
+    std::vector<unsigned char> dynamic;
+
+    // derived, refreshed by update()
+    std::vector<glm::mat4> world;       // node frame in world space (children build on this)
+    std::vector<glm::mat4> model;       // world * box offset * box scale, what the shader receives
+
+    // nodes whose model matrix or color changed during the last update()
+    std::vector<int> changed;
+
+    // add a node that only groups and positions its children
+    // ------------------------------------------------------------------------
+    int addGroup(const std::string& name, int parentNode, const glm::vec3& pos, float yawDegrees = 0.0f)
+    {
+        return addNode(name, parentNode, pos, yawDegrees, glm::vec3(0.0f), glm::vec3(0.0f), glm::vec4(0.0f), false);
+    }
+    // add a node drawn as the unit cube scaled by 'scale' with its corner at 'offset' in the parent frame
+    // ------------------------------------------------------------------------
+    int addBox(const std::string& name, int parentNode, const glm::vec3& offset, const glm::vec3& scale, const glm::vec4& boxColor)
+    {
+        return addNode(name, parentNode, glm::vec3(0.0f), 0.0f, offset, scale, boxColor, true);
+    }
+    // add a node drawn with mesh meshIndex instead of the cube, placed the same way as a box
+    // ------------------------------------------------------------------------
+    int addMesh(const std::string& name, int parentNode, int meshIndex, const glm::vec3& offset, const glm::vec3& scale, const glm::vec4& meshColor)
+    {
+        int node = addNode(name, parentNode, glm::vec3(0.0f), 0.0f, offset, scale, meshColor, true);
+        mesh[node] = meshIndex;
+        return node;
+    }
+    // ------------------------------------------------------------------------
+    void setPosition(int node, const glm::vec3& pos)
+    {
+        if (position[node] == pos)
+            return;
+        position[node] = pos;
+        markDirty(node);
+    }
+    // ------------------------------------------------------------------------
+    void setYaw(int node, float yawDegrees)
+    {
+        if (yaw[node] == yawDegrees)
+            return;
+        yaw[node] = yawDegrees;
+        markDirty(node);
+    }
+    // ------------------------------------------------------------------------
+    void setBox(int node, const glm::vec3& offset, const glm::vec3& scale)
+    {
+        if (boxOffset[node] == offset && boxScale[node] == scale)
+            return;
+        boxOffset[node] = offset;
+        boxScale[node] = scale;
+        markDirty(node);
+    }
+    // ------------------------------------------------------------------------
+    void setColor(int node, const glm::vec4& boxColor)
+    {
+        if (color[node] == boxColor)
+            return;
+        color[node] = boxColor;
+        markDirty(node);
+    }
+    // flag a subtree as animated; nodes added under it later inherit the flag
+    // ------------------------------------------------------------------------
+    void setDynamic(int node)
+    {
+        stack.clear();
+        stack.push_back(node);
+        while (!stack.empty())
+        {
+            int n = stack.back();
+            stack.pop_back();
+            dynamic[n] = 1;
+            for (int child = firstChild[n]; child != -1; child = nextSibling[child])
+                stack.push_back(child);
+        }
+    }
+    // remove every node
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        names.clear();
+        parent.clear();
+        firstChild.clear();
+        nextSibling.clear();
+        position.clear();
+        yaw.clear();
+        boxOffset.clear();
+        boxScale.clear();
+        color.clear();
+        drawable.clear();
+        mesh.clear();
+        dynamic.clear();
+        world.clear();
+        model.clear();
+        changed.clear();
+        dirty.clear();
+        dirtyRoots.clear();
+        lastChild.clear();
+    }
+    // ------------------------------------------------------------------------
+    int find(const std::string& name) const
+    {
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (names[i] == name)
+                return (int)i;
+        }
+        return -1;
+    }
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        return names.size();
+    }
+    // recompute world/model matrices of every dirty subtree; untouched nodes cost nothing
+    // ------------------------------------------------------------------------
+    void update()
+    {
+        changed.clear();
+        for (size_t r = 0; r < dirtyRoots.size(); r++)
+        {
+            int root = dirtyRoots[r];
+            // already refreshed as part of a dirty ancestor's subtree
+            if (!dirty[root])
+                continue;
+            // an ancestor that is still dirty will cover this subtree when its turn comes
+            if (hasDirtyAncestor(root))
+                continue;
+
+            stack.clear();
+            stack.push_back(root);
+            while (!stack.empty())
+            {
+                int node = stack.back();
+                stack.pop_back();
+
+                dirty[node] = 0;
+                changed.push_back(node);
+
+                for (int child = firstChild[node]; child != -1; child = nextSibling[child])
+                    stack.push_back(child);
+            }
+        }
+        dirtyRoots.clear();
+        // depth-first order puts every parent before its children
+        compose(changed.data(), changed.size());
+    }
+    // update() with the dirty subtrees spread over the job system. The top levels are refreshed here until
+    // there are enough independent subtrees to share out; each job walks a range of them into its own
+    // changed list, and the lists are joined in range order so changed does not depend on the scheduling.
+    // ------------------------------------------------------------------------
+    void update(JobSystem& jobs)
+    {
+        if (jobs.threadCount() == 1 || names.size() < PARALLEL_MIN_NODES)
+        {
+            update();
+            return;
+        }
+
+        changed.clear();
+        subtrees.clear();
+        for (size_t r = 0; r < dirtyRoots.size(); r++)
+        {
+            int root = dirtyRoots[r];
+            if (dirty[root] && !hasDirtyAncestor(root))
+                subtrees.push_back(root);
+        }
+        dirtyRoots.clear();
+
+        size_t wanted = (size_t)jobs.threadCount() * SUBTREES_PER_THREAD;
+        for (int level = 0; level < MAX_SPLIT_LEVELS && subtrees.size() < wanted; level++)
+        {
+            bool split = false;
+            size_t levelStart = changed.size();
+            stack.clear();
+            for (size_t i = 0; i < subtrees.size(); i++)
+            {
+                int node = subtrees[i];
+                if (firstChild[node] == -1)
+                {
+                    stack.push_back(node);
+                    continue;
+                }
+                dirty[node] = 0;
+                changed.push_back(node);
+                for (int child = firstChild[node]; child != -1; child = nextSibling[child])
+                    stack.push_back(child);
+                split = true;
+            }
+            subtrees.swap(stack);
+            compose(changed.data() + levelStart, changed.size() - levelStart);
+            if (!split)
+                break;
+        }
+
+        int rangeCount = (int)std::min(subtrees.size(), (size_t)jobs.threadCount() * SUBTREES_PER_THREAD);
+        if (rangeCount == 0)
+            return;
+        if ((int)rangeChanged.size() < rangeCount)
+        {
+            rangeChanged.resize(rangeCount);
+            rangeStacks.resize(rangeCount);
+        }
+        jobs.parallelFor(rangeCount, [&](int range, int) {
+            std::vector<int>& out = rangeChanged[range];
+            std::vector<int>& pending = rangeStacks[range];
+            out.clear();
+            size_t begin = subtrees.size() * range / rangeCount;
+            size_t end = subtrees.size() * (range + 1) / rangeCount;
+            for (size_t i = begin; i < end; i++)
+            {
+                // subtrees are disjoint, so every node is written by exactly one job
+                pending.push_back(subtrees[i]);
+                while (!pending.empty())
+                {
+                    int node = pending.back();
+                    pending.pop_back();
+
+                    dirty[node] = 0;
+                    out.push_back(node);
+
+                    for (int child = firstChild[node]; child != -1; child = nextSibling[child])
+                        pending.push_back(child);
+                }
+            }
+            compose(out.data(), out.size());
+        });
+        for (int range = 0; range < rangeCount; range++)
+            changed.insert(changed.end(), rangeChanged[range].begin(), rangeChanged[range].end());
+    }
+
+private:
+    // below this many nodes the serial update() is faster than handing out jobs
+    static const size_t PARALLEL_MIN_NODES = 4096;
+    static const int SUBTREES_PER_THREAD = 4;
+    static const int MAX_SPLIT_LEVELS = 4;
+
+    std::vector<unsigned char> dirty;
+    std::vector<int> dirtyRoots;
+    std::vector<int> lastChild;
+    std::vector<int> stack;
+    std::vector<int> subtrees;                  // disjoint dirty subtrees, update(JobSystem&) only
+    std::vector<std::vector<int> > rangeChanged;
+    std::vector<std::vector<int> > rangeStacks;
+
+    int addNode(const std::string& name, int parentNode, const glm::vec3& pos, float yawDegrees,
+                const glm::vec3& offset, const glm::vec3& scale, const glm::vec4& boxColor, bool isDrawable)
+    {
+        int node = (int)names.size();
+        names.push_back(name);
+        parent.push_back(parentNode);
+        firstChild.push_back(-1);
+        nextSibling.push_back(-1);
+        lastChild.push_back(-1);
+        position.push_back(pos);
+        yaw.push_back(yawDegrees);
+        boxOffset.push_back(offset);
+        boxScale.push_back(scale);
+        color.push_back(boxColor);
+        drawable.push_back(isDrawable ? 1 : 0);
+        mesh.push_back(-1);
+        dynamic.push_back(parentNode != -1 ? dynamic[parentNode] : 0);
+        world.push_back(glm::mat4(1.0f));
+        model.push_back(glm::mat4(1.0f));
+        dirty.push_back(0);
+
+        // append to the end of the parent's child list so siblings keep their creation order
+        if (parentNode != -1)
+        {
+            if (lastChild[parentNode] == -1)
+                firstChild[parentNode] = node;
+            else
+                nextSibling[lastChild[parentNode]] = node;
+            lastChild[parentNode] = node;
+        }
+
+        markDirty(node);
+        return node;
+    }
+
+    void markDirty(int node)
+    {
+        if (dirty[node])
+            return;
+        dirty[node] = 1;
+        dirtyRoots.push_back(node);
+    }
+
+    bool hasDirtyAncestor(int node) const
+    {
+        for (int p = parent[node]; p != -1; p = parent[p])
+        {
+            if (dirty[p])
+                return true;
+        }
+        return false;
+    }
+
+    void compose(const int* nodes, size_t count)
+    {
+        composeTransforms(nodes, count, parent.data(), position.data(), yaw.data(),
+                          boxOffset.data(), boxScale.data(), world.data(), model.data());
+    }
+};
+
+#endif
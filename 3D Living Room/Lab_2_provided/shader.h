@@ -11,7 +11,14 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "program_cache.h"
+#include "gl_state.h"
+
 #include <string>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -19,10 +26,24 @@
 class Shader
 {
 public:
+    // uniform location resolved once through the cache and set many times; type is the reflected
+    // GL type (GL_FLOAT_VEC4, GL_SAMPLER_2D, ...) so setters can catch a mismatch, GL_NONE if inactive
+    struct Uniform
+    {
+        GLint location;
+        GLenum type;
+    };
+
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // where the program came from, for hot reload
+    std::string vertexPath, fragmentPath, defines;
+    // lookups of names that are not active uniforms of this program
+    mutable unsigned int uniformCacheMisses;
+    // constructor generates the shader on the fly, or loads the linked program from the
+    // program cache; defines (e.g. "#define FOG\n") are inserted right after #version
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* defines = NULL)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines ? defines : ""), uniformCacheMisses(0)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -52,6 +73,31 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
+        if (defines)
+        {
+            vertexCode = insertDefines(vertexCode, defines);
+            fragmentCode = insertDefines(fragmentCode, defines);
+        }
+
+        // warm start: the driver takes the binary it produced last time and skips compiling and linking
+        ID = glCreateProgram();
+        bool useCache = ProgramCache::available();
+        unsigned long long cacheKey = 0;
+        if (useCache)
+        {
+            cacheKey = ProgramCache::key(vertexCode, fragmentCode, defines);
+            if (ProgramCache::load(ID, cacheKey))
+            {
+                ProgramCache::hits()++;
+                cacheUniforms();
+                return;
+            }
+            ProgramCache::misses()++;
+            // a rejected binary leaves the program unusable, start over from source
+            GLState::instance().deleteProgram(ID);
+            ID = glCreateProgram();
+        }
+
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -67,85 +113,303 @@ public:
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        if (useCache)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        if (checkCompileErrors(ID, "PROGRAM") && useCache)
+            ProgramCache::store(ID, cacheKey);
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
 
+        cacheUniforms();
+    }
+    // the uniform cache makes copies expensive; pass shaders by reference
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+    // adopt a program linked elsewhere (hot reload); the old program is deleted and Uniform handles
+    // taken from it must be fetched again
+    // ------------------------------------------------------------------------
+    void replaceProgram(unsigned int program)
+    {
+        GLState::instance().deleteProgram(ID);
+        ID = program;
+        cacheUniforms();
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     {
-        glUseProgram(ID);
+        GLState::instance().useProgram(ID);
+    }
+    // uniform lookup: binary search over the names reflected after linking, -1 if not active
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const char* name) const
+    {
+        return uniform(name).location;
+    }
+    // ------------------------------------------------------------------------
+    Uniform uniform(const char* name) const
+    {
+        Uniform handle;
+        handle.location = -1;
+        handle.type = GL_NONE;
+        const UniformInfo* info = findUniform(name);
+        if (info)
+        {
+            handle.location = info->location;
+            handle.type = info->type;
+        }
+        else
+            uniformCacheMisses++;
+        return handle;
+    }
+    // attach a uniform block of this program to a buffer binding point; no-op if the block is not used
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const char* blockName, GLuint bindingPoint) const
+    {
+        GLuint blockIndex = glGetUniformBlockIndex(ID, blockName);
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, blockIndex, bindingPoint);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
+    void setBool(const char* name, bool value) const
+    {
+        setInt(uniform(name), (int)value);
+    }
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(name.c_str(), value);
     }
     // ------------------------------------------------------------------------
+    void setInt(Uniform u, int value) const
+    {
+        // glUniform1i also sets bools and selects the texture unit of samplers
+        assert(u.location == -1 || u.type == GL_INT || u.type == GL_BOOL || isSampler(u.type));
+        GLState::instance().uniform1i(ID, u.location, value);
+    }
+    void setInt(const char* name, int value) const
+    {
+        setInt(uniform(name), value);
+    }
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(name.c_str(), value);
     }
     // ------------------------------------------------------------------------
+    void setFloat(Uniform u, float value) const
+    {
+        assert(u.location == -1 || u.type == GL_FLOAT);
+        GLState::instance().uniform1f(ID, u.location, value);
+    }
+    void setFloat(const char* name, float value) const
+    {
+        setFloat(uniform(name), value);
+    }
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(name.c_str(), value);
     }
     // ------------------------------------------------------------------------
+    void setVec2(Uniform u, const glm::vec2& value) const
+    {
+        assert(u.location == -1 || u.type == GL_FLOAT_VEC2);
+        GLState::instance().uniform2fv(ID, u.location, &value[0]);
+    }
+    void setVec2(const char* name, const glm::vec2& value) const
+    {
+        setVec2(uniform(name), value);
+    }
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(name.c_str(), value);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        setVec2(name, glm::vec2(x, y));
     }
     // ------------------------------------------------------------------------
+    void setVec3(Uniform u, const glm::vec3& value) const
+    {
+        assert(u.location == -1 || u.type == GL_FLOAT_VEC3);
+        GLState::instance().uniform3fv(ID, u.location, &value[0]);
+    }
+    void setVec3(const char* name, const glm::vec3& value) const
+    {
+        setVec3(uniform(name), value);
+    }
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(name.c_str(), value);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(name, glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
+    void setVec4(Uniform u, const glm::vec4& value) const
+    {
+        assert(u.location == -1 || u.type == GL_FLOAT_VEC4);
+        GLState::instance().uniform4fv(ID, u.location, &value[0]);
+    }
+    void setVec4(const char* name, const glm::vec4& value) const
+    {
+        setVec4(uniform(name), value);
+    }
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec4(name.c_str(), value);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        setVec4(name, glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        Uniform u = uniform(name.c_str());
+        assert(u.location == -1 || u.type == GL_FLOAT_MAT2);
+        GLState::instance().uniformMatrix2fv(ID, u.location, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        Uniform u = uniform(name.c_str());
+        assert(u.location == -1 || u.type == GL_FLOAT_MAT3);
+        GLState::instance().uniformMatrix3fv(ID, u.location, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
+    void setMat4(Uniform u, const glm::mat4& mat) const
+    {
+        assert(u.location == -1 || u.type == GL_FLOAT_MAT4);
+        GLState::instance().uniformMatrix4fv(ID, u.location, &mat[0][0]);
+    }
+    void setMat4(const char* name, const glm::mat4& mat) const
+    {
+        setMat4(uniform(name), mat);
+    }
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(name.c_str(), mat);
+    }
+    // defines go on the line after #version, which must stay the first statement
+    // ------------------------------------------------------------------------
+    static std::string insertDefines(const std::string& code, const char* defines)
+    {
+        std::string::size_type lineEnd = 0;
+        if (code.compare(0, 8, "#version") == 0)
+        {
+            lineEnd = code.find('\n');
+            lineEnd = lineEnd == std::string::npos ? code.size() : lineEnd + 1;
+        }
+        std::string block = defines;
+        if (!block.empty() && block[block.size() - 1] != '\n')
+            block += '\n';
+        return code.substr(0, lineEnd) + block + code.substr(lineEnd);
     }
 
 private:
+    struct UniformInfo
+    {
+        std::string name;
+        GLint location;
+        GLenum type;
+    };
+    // active uniforms of the linked program, sorted by name
+    std::vector<UniformInfo> uniforms;
+
+    // binary search over the reflected names, no std::string built
+    // ------------------------------------------------------------------------
+    const UniformInfo* findUniform(const char* name) const
+    {
+        std::vector<UniformInfo>::const_iterator it = std::lower_bound(uniforms.begin(), uniforms.end(), name,
+            [](const UniformInfo& info, const char* key) { return strcmp(info.name.c_str(), key) < 0; });
+        if (it != uniforms.end() && strcmp(it->name.c_str(), name) == 0)
+            return &*it;
+        return NULL;
+    }
+    // sampler types a GL 3.3 program can declare
+    // ------------------------------------------------------------------------
+    static bool isSampler(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW:
+        case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_2D_RECT: case GL_SAMPLER_2D_RECT_SHADOW: case GL_SAMPLER_BUFFER:
+        case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+        case GL_INT_SAMPLER_1D: case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_3D: case GL_INT_SAMPLER_CUBE:
+        case GL_INT_SAMPLER_1D_ARRAY: case GL_INT_SAMPLER_2D_ARRAY: case GL_INT_SAMPLER_2D_RECT:
+        case GL_INT_SAMPLER_BUFFER: case GL_INT_SAMPLER_2D_MULTISAMPLE: case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+        case GL_UNSIGNED_INT_SAMPLER_1D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_3D:
+        case GL_UNSIGNED_INT_SAMPLER_CUBE: case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+        case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY: case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER: case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+        case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // enumerate the active uniforms once after linking; array elements get one entry each
+    // ------------------------------------------------------------------------
+    void cacheUniforms()
+    {
+        uniforms.clear();
+
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), NULL, &size, &type, &nameBuffer[0]);
+
+            UniformInfo info;
+            info.name = &nameBuffer[0];
+            info.type = type;
+            info.location = glGetUniformLocation(ID, info.name.c_str());
+            // members of uniform blocks have no location
+            if (info.location == -1)
+                continue;
+
+            // arrays of basic types are reported as "name[0]"; make "name" and every "name[i]"
+            // resolvable. Members of struct arrays ("lights[0].position") come one entry per
+            // element and are kept exactly as reported.
+            std::string::size_type length = info.name.size();
+            if (length > 3 && info.name.compare(length - 3, 3, "[0]") == 0)
+            {
+                std::string base = info.name.substr(0, length - 3);
+                for (GLint element = 0; element < size; element++)
+                {
+                    UniformInfo elementInfo;
+                    elementInfo.name = base + "[" + std::to_string(element) + "]";
+                    elementInfo.type = type;
+                    elementInfo.location = glGetUniformLocation(ID, elementInfo.name.c_str());
+                    uniforms.push_back(elementInfo);
+                }
+                info.name = base;
+            }
+            uniforms.push_back(info);
+        }
+
+        std::sort(uniforms.begin(), uniforms.end(),
+            [](const UniformInfo& a, const UniformInfo& b) { return a.name < b.name; });
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -167,6 +431,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success == GL_TRUE;
     }
 };
 #endif
@@ -0,0 +1,447 @@
+//
+//  shader_watcher.h
+//  3D Object Drawing
+//
+//  Shader hot reload that never stalls the render loop. A watcher thread
+//  waits for the shader files to change (inotify on Linux, modification
+//  time polling elsewhere) and reads the new sources. Given a context that
+//  shares objects with the render context, the watcher thread compiles and
+//  links there as well and the render thread only swaps the program ID in.
+//  Without one, the render thread issues the compile and link, and with
+//  KHR/ARB_parallel_shader_compile checks for completion on later frames
+//  instead of waiting. A program that fails to compile or link is thrown
+//  away and the old one stays.
+//
+
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include "shader.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// a second context sharing objects with the render context; both calls are made on the watcher thread
+struct SharedBuildContext
+{
+    std::function<bool()> makeCurrent;
+    std::function<void()> release;
+};
+
+class ShaderWatcher
+{
+public:
+    ShaderWatcher() : running(false), parallelCompile(false), threadBuilds(false) {}
+    ~ShaderWatcher()
+    {
+        stop();
+    }
+
+    // register before start(); the shader's own source paths are watched
+    // ------------------------------------------------------------------------
+    void watch(Shader& shader)
+    {
+        Entry entry;
+        entry.shader = &shader;
+        entry.vertexStamp = entry.fragmentStamp = 0;
+        entries.push_back(entry);
+    }
+    // buildContext: where the watcher thread builds programs; NULL leaves the builds to the render thread
+    // ------------------------------------------------------------------------
+    bool start(const SharedBuildContext* buildContext = NULL)
+    {
+        if (running || entries.empty())
+            return false;
+        if (buildContext)
+            context = *buildContext;
+        else
+            context = SharedBuildContext();
+
+        parallelCompile = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+        // let the driver pick how many compiler threads to use
+        if (GLAD_GL_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        else if (GLAD_GL_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+
+        running = true;
+        thread = std::thread(&ShaderWatcher::run, this);
+        return true;
+    }
+    // ------------------------------------------------------------------------
+    void stop()
+    {
+        if (!running)
+            return;
+        running = false;
+        thread.join();
+        for (size_t i = 0; i < builds.size(); i++)
+            discard(builds[i]);
+        builds.clear();
+        for (size_t i = 0; i < finished.size(); i++)
+            glDeleteProgram(finished[i].program);
+        finished.clear();
+    }
+    // render thread, once per frame: start builds for sources the watcher read and swap in the ones that
+    // finished linking; returns the shaders whose program changed (their non-block uniforms need setting again)
+    // ------------------------------------------------------------------------
+    const std::vector<Shader*>& poll()
+    {
+        reloaded.clear();
+
+        std::vector<Source> sources;
+        std::vector<Build> linked;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            sources.swap(queue);
+            linked.swap(finished);
+        }
+        // built and checked on the watcher thread: nothing left to wait for
+        for (size_t i = 0; i < linked.size(); i++)
+            swapIn(linked[i]);
+
+        for (size_t i = 0; i < sources.size(); i++)
+            builds.push_back(startBuild(sources[i]));
+
+        for (size_t i = 0; i < builds.size(); )
+        {
+            Build& build = builds[i];
+            if (parallelCompile)
+            {
+                GLint done = GL_FALSE;
+                glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+                if (!done)
+                {
+                    i++;
+                    continue;
+                }
+            }
+            if (checkBuild(build))
+                swapIn(build);
+            else
+                discard(build);
+            builds.erase(builds.begin() + i);
+        }
+        return reloaded;
+    }
+
+private:
+    struct Entry
+    {
+        Shader* shader;
+        // polling fallback: modification times of the sources last built successfully (under queueMutex)
+        // and the text last handed to a build (watcher thread only)
+        long long vertexStamp, fragmentStamp;
+        std::string builtVertex, builtFragment;
+    };
+    // new source text read by the watcher thread
+    struct Source
+    {
+        size_t entry;
+        long long vertexStamp, fragmentStamp;
+        std::string vertexCode, fragmentCode;
+    };
+    // a program being compiled and linked by the driver
+    struct Build
+    {
+        size_t entry;
+        long long vertexStamp, fragmentStamp;
+        GLuint program, vertex, fragment;
+    };
+
+    std::vector<Entry> entries;                 // fixed once the thread runs
+    std::thread thread;
+    std::atomic<bool> running;
+    std::mutex queueMutex;
+    std::vector<Source> queue;                  // watcher thread -> render thread
+    std::vector<Build> finished;                // linked on the watcher thread -> render thread
+    std::vector<Build> builds;                  // render thread only
+    std::vector<Shader*> reloaded;
+    bool parallelCompile;
+    SharedBuildContext context;
+    bool threadBuilds;                          // set by the watcher thread before it queues anything
+
+    // watcher thread
+    // ------------------------------------------------------------------------
+    void run()
+    {
+        threadBuilds = context.makeCurrent && context.makeCurrent();
+        if (!threadBuilds && !parallelCompile)
+            std::cout << "shader hot reload: no shared context or parallel compile, reloads compile on the render thread" << std::endl;
+        watchFiles();
+        if (threadBuilds && context.release)
+            context.release();
+    }
+
+    void watchFiles()
+    {
+#if defined(__linux__)
+        // editors either rewrite the file in place or write a temporary and rename it over the original,
+        // so watch the directories for both instead of the files themselves
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cout << "ERROR::SHADER_WATCHER:: inotify is not available, shader hot reload is off" << std::endl;
+            return;
+        }
+        std::vector<std::string> directories;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            directories.push_back(directoryOf(entries[i].shader->vertexPath));
+            directories.push_back(directoryOf(entries[i].shader->fragmentPath));
+        }
+        for (size_t i = 0; i < directories.size(); i++)
+            inotify_add_watch(fd, directories[i].c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+        // aligned for the inotify_event structs read into it
+        alignas(struct inotify_event) char buffer[4096];
+        while (running)
+        {
+            struct pollfd descriptor = { fd, POLLIN, 0 };
+            // the timeout only bounds how long stop() waits for the thread
+            if (::poll(&descriptor, 1, 100) <= 0)
+                continue;
+
+            ssize_t length;
+            std::vector<std::string> changed;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* p = buffer; p < buffer + length; )
+                {
+                    struct inotify_event* event = (struct inotify_event*)p;
+                    if (event->len > 0)
+                        changed.push_back(event->name);
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                const Shader& shader = *entries[i].shader;
+                for (size_t c = 0; c < changed.size(); c++)
+                {
+                    if (changed[c] == fileNameOf(shader.vertexPath) || changed[c] == fileNameOf(shader.fragmentPath))
+                    {
+                        Source source;
+                        if (readSources(i, source))
+                            submit(source);
+                        break;
+                    }
+                }
+            }
+        }
+        close(fd);
+#else
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                entries[i].vertexStamp = modificationTime(entries[i].shader->vertexPath);
+                entries[i].fragmentStamp = modificationTime(entries[i].shader->fragmentPath);
+            }
+        }
+        while (running)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                Entry& entry = entries[i];
+                long long vertexStamp = modificationTime(entry.shader->vertexPath);
+                long long fragmentStamp = modificationTime(entry.shader->fragmentPath);
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    if (vertexStamp == entry.vertexStamp && fragmentStamp == entry.fragmentStamp)
+                        continue;
+                }
+                // the stamps are only kept once a build of these files succeeds: a file caught halfway through
+                // being written is read again on the next round, even when the rest of the write lands in the
+                // same modification time tick
+                Source source;
+                if (!readSources(i, source))
+                    continue;
+                // already built (and waiting for its stamps) or failed: wait for the text to change
+                if (source.vertexCode == entry.builtVertex && source.fragmentCode == entry.builtFragment)
+                    continue;
+                entry.builtVertex = source.vertexCode;
+                entry.builtFragment = source.fragmentCode;
+                source.vertexStamp = vertexStamp;
+                source.fragmentStamp = fragmentStamp;
+                submit(source);
+            }
+        }
+#endif
+    }
+
+    // watcher thread: the file I/O happens here, never on the render thread
+    bool readSources(size_t entry, Source& source)
+    {
+        const Shader& shader = *entries[entry].shader;
+        source.entry = entry;
+        source.vertexStamp = source.fragmentStamp = 0;
+        if (!readFile(shader.vertexPath, source.vertexCode) || !readFile(shader.fragmentPath, source.fragmentCode))
+            return false;
+        if (!shader.defines.empty())
+        {
+            source.vertexCode = Shader::insertDefines(source.vertexCode, shader.defines.c_str());
+            source.fragmentCode = Shader::insertDefines(source.fragmentCode, shader.defines.c_str());
+        }
+        return true;
+    }
+
+    // watcher thread: build here on the shared context, or hand the sources to the render thread
+    void submit(const Source& source)
+    {
+        if (!threadBuilds)
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(source);
+            return;
+        }
+        Build build = startBuild(source);
+        // the status queries wait for the compiler, which only holds up this thread
+        if (!checkBuild(build))
+        {
+            glDeleteProgram(build.program);
+            glDeleteShader(build.vertex);
+            glDeleteShader(build.fragment);
+            return;
+        }
+        // the render context may only use the program once this context is done with it
+        glFinish();
+        std::lock_guard<std::mutex> lock(queueMutex);
+        finished.push_back(build);
+    }
+
+    static bool readFile(const std::string& path, std::string& contents)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+            return false;
+        std::stringstream stream;
+        stream << file.rdbuf();
+        contents = stream.str();
+        // a file caught halfway through being rewritten reads as empty; the next event brings the full text
+        return !contents.empty();
+    }
+
+    static std::string directoryOf(const std::string& path)
+    {
+        std::string::size_type slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? "." : path.substr(0, slash);
+    }
+
+    static std::string fileNameOf(const std::string& path)
+    {
+        std::string::size_type slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+#if !defined(__linux__)
+    static long long modificationTime(const std::string& path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+        return (long long)info.st_mtime;
+    }
+#endif
+
+    // issues the commands; on the render thread the driver compiles in the background when it can
+    Build startBuild(const Source& source)
+    {
+        Build build;
+        build.entry = source.entry;
+        build.vertexStamp = source.vertexStamp;
+        build.fragmentStamp = source.fragmentStamp;
+        const char* vertexCode = source.vertexCode.c_str();
+        const char* fragmentCode = source.fragmentCode.c_str();
+
+        build.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(build.vertex, 1, &vertexCode, NULL);
+        glCompileShader(build.vertex);
+        build.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(build.fragment, 1, &fragmentCode, NULL);
+        glCompileShader(build.fragment);
+
+        build.program = glCreateProgram();
+        glAttachShader(build.program, build.vertex);
+        glAttachShader(build.program, build.fragment);
+        glLinkProgram(build.program);
+        return build;
+    }
+
+    // compile and link status, with the log of what failed; on success the shader objects are released
+    bool checkBuild(Build& build)
+    {
+        const Shader& shader = *entries[build.entry].shader;
+        GLint vertexOk = GL_FALSE, fragmentOk = GL_FALSE, linked = GL_FALSE;
+        glGetShaderiv(build.vertex, GL_COMPILE_STATUS, &vertexOk);
+        glGetShaderiv(build.fragment, GL_COMPILE_STATUS, &fragmentOk);
+        glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+
+        if (vertexOk && fragmentOk && linked)
+        {
+            glDetachShader(build.program, build.vertex);
+            glDetachShader(build.program, build.fragment);
+            glDeleteShader(build.vertex);
+            glDeleteShader(build.fragment);
+            build.vertex = build.fragment = 0;
+            return true;
+        }
+
+        GLchar infoLog[1024];
+        if (!vertexOk)
+        {
+            glGetShaderInfoLog(build.vertex, 1024, NULL, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: VERTEX (" << shader.vertexPath << ")\n" << infoLog << std::endl;
+        }
+        else if (!fragmentOk)
+        {
+            glGetShaderInfoLog(build.fragment, 1024, NULL, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: FRAGMENT (" << shader.fragmentPath << ")\n" << infoLog << std::endl;
+        }
+        else
+        {
+            glGetProgramInfoLog(build.program, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog << std::endl;
+        }
+        std::cout << "keeping the previous program" << std::endl;
+        return false;
+    }
+
+    // render thread: adopt a linked program and let the watcher keep the stamps of its sources
+    void swapIn(const Build& build)
+    {
+        Entry& entry = entries[build.entry];
+        entry.shader->replaceProgram(build.program);
+        reloaded.push_back(entry.shader);
+        std::cout << "reloaded " << entry.shader->vertexPath << " + " << entry.shader->fragmentPath << std::endl;
+        std::lock_guard<std::mutex> lock(queueMutex);
+        entry.vertexStamp = build.vertexStamp;
+        entry.fragmentStamp = build.fragmentStamp;
+    }
+
+    static void discard(Build& build)
+    {
+        GLState::instance().deleteProgram(build.program);
+        glDeleteShader(build.vertex);
+        glDeleteShader(build.fragment);
+    }
+};
+
+#endif
@@ -0,0 +1,436 @@
+//
+//  software_rasterizer.h
+//  3D Object Drawing
+//
+//  CPU rendering backend for machines without a GPU. Takes the same draw
+//  stream as the GL path (one mesh, a model matrix and a flat color per
+//  draw), clips against the near plane, bins triangles into 64x64 tiles and
+//  rasterizes the tiles as jobs. Edge functions and depth are
+//  evaluated four pixels at a time with SSE, and every 8x8 block keeps its
+//  farthest depth so covered blocks are skipped without touching pixels.
+//
+//  Matches the GL path's conventions: pixel centers at +0.5, a top-left
+//  fill rule, GL_LESS depth test, no face culling. There is no lighting:
+//  the images match GL runs made with --no-lighting.
+//
+
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include "job_system.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTER_USE_SSE 1
+#endif
+
+class SoftwareRasterizer
+{
+public:
+    static const int TILE_SIZE = 64;
+    static const int BLOCK_SIZE = 8;            // hierarchical depth granularity
+    static const int BLOCKS_PER_TILE = TILE_SIZE / BLOCK_SIZE;
+
+    int width, height;
+
+    SoftwareRasterizer() : width(0), height(0), stride(0), tilesX(0), tilesY(0), clearColor(0), jobs(NULL) {}
+
+    // setup and tiles run on jobSystem, which the caller starts and stops
+    // ------------------------------------------------------------------------
+    void init(int w, int h, JobSystem& jobSystem)
+    {
+        width = w;
+        height = h;
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+        // whole tiles are allocated so the SIMD loops never need an edge case; the border is cropped on output
+        stride = tilesX * TILE_SIZE;
+        color.assign((size_t)stride * tilesY * TILE_SIZE, 0);
+        depth.assign(color.size(), 1.0f);
+        blockMaxDepth.assign((size_t)tilesX * tilesY * BLOCKS_PER_TILE * BLOCKS_PER_TILE, 1.0f);
+        bins.resize(tilesX * tilesY);
+        jobs = &jobSystem;
+    }
+    // mesh with the 6-float (position, normal) stride of cube_vertices; only the positions are used.
+    // Triangles with an index past the vertices are dropped.
+    // ------------------------------------------------------------------------
+    void setMesh(const float* vertices, int vertexCount, const unsigned int* indices, int indexCount)
+    {
+        meshPositions.resize(vertexCount);
+        for (int i = 0; i < vertexCount; i++)
+            meshPositions[i] = glm::vec3(vertices[i * 6], vertices[i * 6 + 1], vertices[i * 6 + 2]);
+        meshIndices.clear();
+        for (int i = 0; i + 2 < indexCount; i += 3)
+        {
+            if (indices[i] >= (unsigned int)vertexCount || indices[i + 1] >= (unsigned int)vertexCount
+                || indices[i + 2] >= (unsigned int)vertexCount)
+            {
+                std::cout << "ERROR::SOFTWARE_RASTERIZER:: triangle " << i / 3 << " indexes past the " << vertexCount << " vertices" << std::endl;
+                continue;
+            }
+            meshIndices.insert(meshIndices.end(), indices + i, indices + i + 3);
+        }
+    }
+    // ------------------------------------------------------------------------
+    void beginFrame(const glm::vec4& clear, const glm::mat4& viewProjection)
+    {
+        clearColor = packColor(clear);
+        frameViewProjection = viewProjection;
+        draws.clear();
+    }
+    // ------------------------------------------------------------------------
+    void submit(const glm::mat4& model, const glm::vec4& drawColor)
+    {
+        Draw draw;
+        draw.model = model;
+        draw.color = packColor(drawColor);
+        draws.push_back(draw);
+    }
+    // transform and bin everything submitted since beginFrame, then rasterize all tiles
+    // ------------------------------------------------------------------------
+    void endFrame()
+    {
+        // 1. vertex transform, clipping and triangle setup; each chunk of draws fills its own list
+        const int drawsPerChunk = 64;
+        int chunkCount = ((int)draws.size() + drawsPerChunk - 1) / drawsPerChunk;
+        if ((int)chunkTriangles.size() < chunkCount)
+        {
+            chunkTriangles.resize(chunkCount);
+            chunkClip.resize(chunkCount);
+        }
+        jobs->parallelFor(chunkCount, [&](int chunk, int) {
+            std::vector<Triangle>& out = chunkTriangles[chunk];
+            std::vector<glm::vec4>& clip = chunkClip[chunk];
+            out.clear();
+            clip.resize(meshPositions.size());
+            int end = std::min((int)draws.size(), (chunk + 1) * drawsPerChunk);
+            for (int d = chunk * drawsPerChunk; d < end; d++)
+                setupDraw(draws[d], clip, out);
+        });
+
+        // 2. binning in submission order, which keeps equal-depth results identical to GL's draw order
+        triangles.clear();
+        for (int chunk = 0; chunk < chunkCount; chunk++)
+            triangles.insert(triangles.end(), chunkTriangles[chunk].begin(), chunkTriangles[chunk].end());
+        for (size_t t = 0; t < bins.size(); t++)
+            bins[t].clear();
+        for (size_t i = 0; i < triangles.size(); i++)
+        {
+            const Triangle& tri = triangles[i];
+            for (int ty = tri.minY / TILE_SIZE; ty <= tri.maxY / TILE_SIZE; ty++)
+            {
+                for (int tx = tri.minX / TILE_SIZE; tx <= tri.maxX / TILE_SIZE; tx++)
+                    bins[ty * tilesX + tx].push_back((int)i);
+            }
+        }
+
+        // 3. tiles are independent: clear and rasterize each on whichever thread takes it
+        jobs->parallelFor(tilesX * tilesY, [&](int tile, int) {
+            rasterizeTile(tile);
+        });
+    }
+    // binary PPM (P6) of the last frame
+    // ------------------------------------------------------------------------
+    bool writePPM(const char* path) const
+    {
+        FILE* file = fopen(path, "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::SOFTWARE_RASTERIZER:: Could not open " << path << " for writing" << std::endl;
+            return false;
+        }
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        std::vector<unsigned char> row(width * 3);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                unsigned int c = color[(size_t)y * stride + x];
+                row[x * 3] = (unsigned char)(c & 0xff);
+                row[x * 3 + 1] = (unsigned char)((c >> 8) & 0xff);
+                row[x * 3 + 2] = (unsigned char)((c >> 16) & 0xff);
+            }
+            fwrite(&row[0], 1, row.size(), file);
+        }
+        fclose(file);
+        return true;
+    }
+
+private:
+    struct Draw
+    {
+        glm::mat4 model;
+        unsigned int color;
+    };
+    // screen-space triangle ready for rasterization; edge i is a*x + b*y + c, inside when >= 0
+    struct Triangle
+    {
+        float a[3], b[3], c[3];
+        bool topLeft[3];
+        float z0, dzdx, dzdy;       // depth plane: z = z0 + dzdx * x + dzdy * y
+        float minZ;
+        int minX, minY, maxX, maxY; // pixel bounds, already clamped to the screen
+        unsigned int color;
+    };
+
+    int stride, tilesX, tilesY;
+    std::vector<unsigned int> color;    // RGBA8, row-major with 'stride' pixels per row
+    std::vector<float> depth;
+    std::vector<float> blockMaxDepth;   // per 8x8 block, tile-major: the farthest depth stored in it
+    unsigned int clearColor;
+
+    std::vector<glm::vec3> meshPositions;
+    std::vector<unsigned int> meshIndices;
+    glm::mat4 frameViewProjection;
+    std::vector<Draw> draws;
+    std::vector<std::vector<Triangle> > chunkTriangles;
+    std::vector<std::vector<glm::vec4> > chunkClip;     // per chunk: the mesh's vertices in clip space
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<int> > bins;
+    JobSystem* jobs;
+
+    static unsigned int packColor(const glm::vec4& c)
+    {
+        unsigned int r = (unsigned int)(std::min(std::max(c.x, 0.0f), 1.0f) * 255.0f + 0.5f);
+        unsigned int g = (unsigned int)(std::min(std::max(c.y, 0.0f), 1.0f) * 255.0f + 0.5f);
+        unsigned int b = (unsigned int)(std::min(std::max(c.z, 0.0f), 1.0f) * 255.0f + 0.5f);
+        unsigned int a = (unsigned int)(std::min(std::max(c.w, 0.0f), 1.0f) * 255.0f + 0.5f);
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    // clip has one entry per mesh vertex and is overwritten
+    void setupDraw(const Draw& draw, std::vector<glm::vec4>& clip, std::vector<Triangle>& out) const
+    {
+        glm::mat4 mvp = frameViewProjection * draw.model;
+        for (size_t i = 0; i < meshPositions.size(); i++)
+            clip[i] = mvp * glm::vec4(meshPositions[i], 1.0f);
+
+        for (size_t i = 0; i + 2 < meshIndices.size(); i += 3)
+        {
+            glm::vec4 polygon[4];
+            int count = clipNear(clip[meshIndices[i]], clip[meshIndices[i + 1]], clip[meshIndices[i + 2]], polygon);
+            // the clipped polygon is convex, fan it out
+            for (int k = 1; k + 1 < count; k++)
+                setupTriangle(polygon[0], polygon[k], polygon[k + 1], draw.color, out);
+        }
+    }
+
+    // Sutherland-Hodgman against the near plane (z >= -w); everything else is handled by the screen clamp
+    // and the depth range test
+    static int clipNear(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2, glm::vec4* result)
+    {
+        const glm::vec4 input[3] = { v0, v1, v2 };
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const glm::vec4& current = input[i];
+            const glm::vec4& next = input[(i + 1) % 3];
+            float dCurrent = current.z + current.w;
+            float dNext = next.z + next.w;
+            if (dCurrent >= 0.0f)
+                result[count++] = current;
+            if ((dCurrent >= 0.0f) != (dNext >= 0.0f))
+            {
+                float t = dCurrent / (dCurrent - dNext);
+                result[count++] = current + (next - current) * t;
+            }
+        }
+        return count;
+    }
+
+    void setupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, unsigned int drawColor,
+                       std::vector<Triangle>& out) const
+    {
+        // viewport transform; rows go top down like the output image
+        glm::vec3 p[3];
+        const glm::vec4* clip[3] = { &c0, &c1, &c2 };
+        for (int i = 0; i < 3; i++)
+        {
+            float invW = 1.0f / clip[i]->w;
+            p[i].x = (clip[i]->x * invW * 0.5f + 0.5f) * width;
+            p[i].y = (0.5f - clip[i]->y * invW * 0.5f) * height;
+            p[i].z = clip[i]->z * invW * 0.5f + 0.5f;
+        }
+
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (area == 0.0f || std::isnan(area))
+            return;
+        // both windings are drawn; make the edge functions positive inside
+        if (area < 0.0f)
+        {
+            std::swap(p[1], p[2]);
+            area = -area;
+        }
+
+        Triangle tri;
+        float minX = std::min(p[0].x, std::min(p[1].x, p[2].x));
+        float maxX = std::max(p[0].x, std::max(p[1].x, p[2].x));
+        float minY = std::min(p[0].y, std::min(p[1].y, p[2].y));
+        float maxY = std::max(p[0].y, std::max(p[1].y, p[2].y));
+        // pixel (x, y) has its center at (x + 0.5, y + 0.5); the edge functions decide the exact boundary
+        tri.minX = std::max(0, (int)std::ceil(minX - 0.5f));
+        tri.minY = std::max(0, (int)std::ceil(minY - 0.5f));
+        tri.maxX = std::min(width - 1, (int)std::floor(maxX - 0.5f));
+        tri.maxY = std::min(height - 1, (int)std::floor(maxY - 0.5f));
+        if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+            return;
+
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec3& from = p[(e + 1) % 3];
+            const glm::vec3& to = p[(e + 2) % 3];
+            // edge opposite vertex e; evaluated at pixel centers
+            tri.a[e] = from.y - to.y;
+            tri.b[e] = to.x - from.x;
+            tri.c[e] = from.x * to.y - from.y * to.x + 0.5f * (tri.a[e] + tri.b[e]);
+            // y grows downwards here, so "top" edges run right-to-left in these coordinates
+            tri.topLeft[e] = (tri.a[e] == 0.0f && tri.b[e] < 0.0f) || tri.a[e] > 0.0f;
+        }
+
+        // depth plane through the three vertices, in pixel-center coordinates
+        float invArea = 1.0f / area;
+        float dz1 = p[1].z - p[0].z, dz2 = p[2].z - p[0].z;
+        float dx1 = p[1].x - p[0].x, dx2 = p[2].x - p[0].x;
+        float dy1 = p[1].y - p[0].y, dy2 = p[2].y - p[0].y;
+        tri.dzdx = (dz1 * dy2 - dz2 * dy1) * invArea;
+        tri.dzdy = (dz2 * dx1 - dz1 * dx2) * invArea;
+        tri.z0 = p[0].z - tri.dzdx * (p[0].x - 0.5f) - tri.dzdy * (p[0].y - 0.5f);
+        tri.minZ = std::min(p[0].z, std::min(p[1].z, p[2].z));
+        if (tri.minZ >= 1.0f)
+            return;
+        tri.color = drawColor;
+        out.push_back(tri);
+    }
+
+    void rasterizeTile(int tile)
+    {
+        int tileX = (tile % tilesX) * TILE_SIZE;
+        int tileY = (tile / tilesX) * TILE_SIZE;
+        float* tileBlockMax = &blockMaxDepth[(size_t)tile * BLOCKS_PER_TILE * BLOCKS_PER_TILE];
+
+        for (int y = tileY; y < tileY + TILE_SIZE; y++)
+        {
+            std::fill(&color[(size_t)y * stride + tileX], &color[(size_t)y * stride + tileX] + TILE_SIZE, clearColor);
+            std::fill(&depth[(size_t)y * stride + tileX], &depth[(size_t)y * stride + tileX] + TILE_SIZE, 1.0f);
+        }
+        std::fill(tileBlockMax, tileBlockMax + BLOCKS_PER_TILE * BLOCKS_PER_TILE, 1.0f);
+
+        const std::vector<int>& bin = bins[tile];
+        for (size_t i = 0; i < bin.size(); i++)
+        {
+            const Triangle& tri = triangles[bin[i]];
+            int x0 = std::max(tri.minX, tileX), x1 = std::min(tri.maxX, tileX + TILE_SIZE - 1);
+            int y0 = std::max(tri.minY, tileY), y1 = std::min(tri.maxY, tileY + TILE_SIZE - 1);
+
+            for (int by = (y0 - tileY) / BLOCK_SIZE; by <= (y1 - tileY) / BLOCK_SIZE; by++)
+            {
+                for (int bx = (x0 - tileX) / BLOCK_SIZE; bx <= (x1 - tileX) / BLOCK_SIZE; bx++)
+                {
+                    float& blockMax = tileBlockMax[by * BLOCKS_PER_TILE + bx];
+                    // everything in the block is already nearer than any point of the triangle
+                    if (tri.minZ >= blockMax)
+                        continue;
+                    int blockX = tileX + bx * BLOCK_SIZE, blockY = tileY + by * BLOCK_SIZE;
+                    if (rasterizeBlock(tri, blockX, blockY, std::max(y0, blockY), std::min(y1, blockY + BLOCK_SIZE - 1)))
+                        blockMax = farthestDepth(blockX, blockY);
+                }
+            }
+        }
+    }
+
+    // one 8x8 block, rows rowBegin..rowEnd; returns whether any pixel was written
+    bool rasterizeBlock(const Triangle& tri, int blockX, int blockY, int rowBegin, int rowEnd)
+    {
+        (void)blockY;
+        bool written = false;
+#ifdef RASTER_USE_SSE
+        const __m128 laneOffset = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 zero = _mm_setzero_ps();
+        __m128 topLeft[3];
+        for (int e = 0; e < 3; e++)
+            topLeft[e] = tri.topLeft[e] ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+        const __m128i drawColor = _mm_set1_epi32((int)tri.color);
+
+        for (int y = rowBegin; y <= rowEnd; y++)
+        {
+            for (int x = blockX; x < blockX + BLOCK_SIZE; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffset);
+                __m128 py = _mm_set1_ps((float)y);
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int e = 0; e < 3; e++)
+                {
+                    __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.a[e]), px), _mm_mul_ps(_mm_set1_ps(tri.b[e]), py)),
+                                          _mm_set1_ps(tri.c[e]));
+                    // strictly inside, or exactly on a top/left edge
+                    __m128 edge = _mm_or_ps(_mm_cmpgt_ps(w, zero), _mm_and_ps(_mm_cmpeq_ps(w, zero), topLeft[e]));
+                    inside = _mm_and_ps(inside, edge);
+                }
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                __m128 z = _mm_add_ps(_mm_add_ps(_mm_set1_ps(tri.z0), _mm_mul_ps(_mm_set1_ps(tri.dzdx), px)),
+                                      _mm_mul_ps(_mm_set1_ps(tri.dzdy), py));
+                float* depthRow = &depth[(size_t)y * stride + x];
+                __m128 stored = _mm_loadu_ps(depthRow);
+                __m128 pass = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(z, stored), _mm_cmpge_ps(z, zero)));
+                if (_mm_movemask_ps(pass) == 0)
+                    continue;
+
+                _mm_storeu_ps(depthRow, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+                __m128i* colorRow = (__m128i*)&color[(size_t)y * stride + x];
+                __m128i passMask = _mm_castps_si128(pass);
+                __m128i previous = _mm_loadu_si128(colorRow);
+                _mm_storeu_si128(colorRow, _mm_or_si128(_mm_and_si128(passMask, drawColor), _mm_andnot_si128(passMask, previous)));
+                written = true;
+            }
+        }
+#else
+        for (int y = rowBegin; y <= rowEnd; y++)
+        {
+            for (int x = blockX; x < blockX + BLOCK_SIZE; x++)
+            {
+                bool inside = true;
+                for (int e = 0; e < 3 && inside; e++)
+                {
+                    float w = tri.a[e] * x + tri.b[e] * y + tri.c[e];
+                    inside = w > 0.0f || (w == 0.0f && tri.topLeft[e]);
+                }
+                if (!inside)
+                    continue;
+                float z = tri.z0 + tri.dzdx * x + tri.dzdy * y;
+                float& stored = depth[(size_t)y * stride + x];
+                if (z < stored && z >= 0.0f)
+                {
+                    stored = z;
+                    color[(size_t)y * stride + x] = tri.color;
+                    written = true;
+                }
+            }
+        }
+#endif
+        return written;
+    }
+
+    float farthestDepth(int blockX, int blockY) const
+    {
+        float farthest = 0.0f;
+        for (int y = blockY; y < blockY + BLOCK_SIZE; y++)
+        {
+            const float* row = &depth[(size_t)y * stride + blockX];
+            for (int x = 0; x < BLOCK_SIZE; x++)
+                farthest = std::max(farthest, row[x]);
+        }
+        return farthest;
+    }
+};
+
+#endif
@@ -0,0 +1,219 @@
+//
+//  static_batch.h
+//  3D Object Drawing
+//
+//  Boxes that never move are pre-transformed into world space once and
+//  merged (position, per-vertex color and world normal) into a single
+//  VBO/EBO that is drawn with one call. Every box owns a fixed slot of 24
+//  vertices and 36 indices, so adding or editing a box only re-uploads that
+//  box's range.
+//
+
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "mesh_format.h"
+
+#include <vector>
+
+// position at location 0, color at location 1 and the normal, packed like a mesh normal, at location 7
+struct BakedVertex
+{
+    glm::vec3 position;
+    glm::vec3 color;
+    uint32_t normal;
+};
+
+class StaticBatch
+{
+public:
+    static const unsigned int VERTICES_PER_BOX = 24;
+    static const unsigned int INDICES_PER_BOX = 36;
+
+    unsigned int VAO, VBO, EBO;
+
+    StaticBatch() : VAO(0), VBO(0), EBO(0), capacity(0), dirtyBegin(0), dirtyEnd(0) {}
+
+    // cubeVertices uses the layout of cube_vertices: position and normal, 6 floats a vertex
+    // ------------------------------------------------------------------------
+    void init(const float* cubeVertices, const unsigned int* cubeIndices)
+    {
+        for (unsigned int i = 0; i < VERTICES_PER_BOX; i++)
+        {
+            corners[i] = glm::vec3(cubeVertices[i * 6], cubeVertices[i * 6 + 1], cubeVertices[i * 6 + 2]);
+            normals[i] = glm::vec3(cubeVertices[i * 6 + 3], cubeVertices[i * 6 + 4], cubeVertices[i * 6 + 5]);
+        }
+        for (unsigned int i = 0; i < INDICES_PER_BOX; i++)
+            boxIndices[i] = cubeIndices[i];
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        GLState::instance().bindVertexArray(VAO);
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        // position attribute
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BakedVertex), (void*)0);
+        glEnableVertexAttribArray(0);
+        // color attribute
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BakedVertex), (void*)sizeof(glm::vec3));
+        glEnableVertexAttribArray(1);
+        // normal attribute
+        glVertexAttribPointer(7, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(BakedVertex), (void*)(2 * sizeof(glm::vec3)));
+        glEnableVertexAttribArray(7);
+
+        GLState::instance().bindVertexArray(0);
+    }
+    // bake a new box; returns its slot for later edits
+    // ------------------------------------------------------------------------
+    int add(const glm::mat4& model, const glm::vec4& color)
+    {
+        int slot = (int)boxCount();
+        vertices.resize(vertices.size() + VERTICES_PER_BOX);
+        indices.resize(indices.size() + INDICES_PER_BOX);
+        for (unsigned int i = 0; i < INDICES_PER_BOX; i++)
+            indices[slot * INDICES_PER_BOX + i] = slot * VERTICES_PER_BOX + boxIndices[i];
+        bake(slot, model, color);
+        return slot;
+    }
+    // re-bake an existing box in place
+    // ------------------------------------------------------------------------
+    void update(int slot, const glm::mat4& model, const glm::vec4& color)
+    {
+        bake(slot, model, color);
+    }
+    // forget every box; the GPU buffers are kept and refilled from slot 0
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        vertices.clear();
+        indices.clear();
+        dirtyBegin = dirtyEnd = 0;
+    }
+    // ------------------------------------------------------------------------
+    size_t boxCount() const
+    {
+        return vertices.size() / VERTICES_PER_BOX;
+    }
+    // push the boxes touched since the last upload to the GPU
+    // ------------------------------------------------------------------------
+    void upload()
+    {
+        if (dirtyBegin == dirtyEnd)
+            return;
+
+        GLState::instance().bindVertexArray(VAO);
+        if (boxCount() > capacity)
+        {
+            // reallocate with headroom and send everything once
+            capacity = boxCount() * 2;
+            GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, capacity * VERTICES_PER_BOX * sizeof(BakedVertex), NULL, GL_STATIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(BakedVertex), vertices.data());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, capacity * INDICES_PER_BOX * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data());
+        }
+        else
+        {
+            // only the slot range that changed; indices of existing slots never change but new ones need writing
+            GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferSubData(GL_ARRAY_BUFFER, dirtyBegin * VERTICES_PER_BOX * sizeof(BakedVertex),
+                            (dirtyEnd - dirtyBegin) * VERTICES_PER_BOX * sizeof(BakedVertex), &vertices[dirtyBegin * VERTICES_PER_BOX]);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, dirtyBegin * INDICES_PER_BOX * sizeof(unsigned int),
+                            (dirtyEnd - dirtyBegin) * INDICES_PER_BOX * sizeof(unsigned int), &indices[dirtyBegin * INDICES_PER_BOX]);
+        }
+        GLState::instance().bindVertexArray(0);
+
+        dirtyBegin = dirtyEnd = 0;
+    }
+    // all baked boxes in one draw call; the caller binds a shader that reads the vertex color
+    // ------------------------------------------------------------------------
+    void draw() const
+    {
+        if (vertices.empty())
+            return;
+        GLState::instance().bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+    }
+    // only the slots flagged in slotVisible; each run of consecutive visible slots is one range of a multi-draw
+    // ------------------------------------------------------------------------
+    void drawVisible(const unsigned char* slotVisible)
+    {
+        runCounts.clear();
+        runOffsets.clear();
+        size_t count = boxCount();
+        for (size_t slot = 0; slot < count; )
+        {
+            if (!slotVisible[slot])
+            {
+                slot++;
+                continue;
+            }
+            size_t first = slot;
+            while (slot < count && slotVisible[slot])
+                slot++;
+            runCounts.push_back((GLsizei)((slot - first) * INDICES_PER_BOX));
+            runOffsets.push_back((const void*)(first * INDICES_PER_BOX * sizeof(unsigned int)));
+        }
+        if (runCounts.empty())
+            return;
+        GLState::instance().bindVertexArray(VAO);
+        glMultiDrawElements(GL_TRIANGLES, runCounts.data(), GL_UNSIGNED_INT, runOffsets.data(), (GLsizei)runCounts.size());
+    }
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        GLState::instance().deleteVertexArray(VAO);
+        GLState::instance().deleteBuffer(VBO);
+        GLState::instance().deleteBuffer(EBO);
+        VAO = VBO = EBO = 0;
+        capacity = 0;
+    }
+
+private:
+    glm::vec3 corners[VERTICES_PER_BOX];
+    glm::vec3 normals[VERTICES_PER_BOX];
+    unsigned int boxIndices[INDICES_PER_BOX];
+
+    std::vector<BakedVertex> vertices;
+    std::vector<unsigned int> indices;
+    size_t capacity;                    // boxes the GPU buffers can hold
+    size_t dirtyBegin, dirtyEnd;        // slot range waiting for upload()
+    std::vector<GLsizei> runCounts;     // scratch for drawVisible()
+    std::vector<const void*> runOffsets;
+
+    void bake(int slot, const glm::mat4& model, const glm::vec4& color)
+    {
+        // the scale is uneven and can be negative, so normals take the inverse transpose
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        for (unsigned int i = 0; i < VERTICES_PER_BOX; i++)
+        {
+            BakedVertex& v = vertices[slot * VERTICES_PER_BOX + i];
+            v.position = glm::vec3(model * glm::vec4(corners[i], 1.0f));
+            v.color = glm::vec3(color);
+            glm::vec3 n = glm::normalize(normalMatrix * normals[i]);
+            v.normal = packMeshNormal(n.x, n.y, n.z);
+        }
+
+        if (dirtyBegin == dirtyEnd)
+        {
+            dirtyBegin = slot;
+            dirtyEnd = slot + 1;
+        }
+        else
+        {
+            if ((size_t)slot < dirtyBegin)
+                dirtyBegin = slot;
+            if ((size_t)slot + 1 > dirtyEnd)
+                dirtyEnd = slot + 1;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,271 @@
+//
+//  obj2mesh.cpp
+//  3D Object Drawing
+//
+//  Offline converter from Wavefront OBJ to the binary .mesh format of
+//  mesh_format.h. Reads v/vn/f (polygons are fanned into triangles, missing
+//  normals are averaged from the faces), welds identical position/normal
+//  pairs, quantizes and writes the file ready to be mapped by the viewer.
+//  Standalone, no GL needed:
+//
+//    g++ -std=c++14 -O2 tools/obj2mesh.cpp -o obj2mesh
+//    obj2mesh chair.obj chair.mesh
+//
+
+#include "../mesh_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Vec3
+{
+    float x, y, z;
+};
+
+// one corner of a face: 0-based position and normal index (-1 = none)
+struct Corner
+{
+    int position;
+    int normal;
+};
+
+// OBJ indices are 1-based, negative ones count back from the last element
+// ------------------------------------------------------------------------
+static int resolveIndex(long index, size_t count)
+{
+    if (index > 0)
+        return (int)index - 1;
+    if (index < 0)
+        return (int)count + (int)index;
+    return -1;
+}
+// "p", "p/t", "p//n" or "p/t/n"
+// ------------------------------------------------------------------------
+static bool parseCorner(const char* token, size_t positionCount, size_t normalCount, Corner& corner)
+{
+    char* end;
+    long p = strtol(token, &end, 10);
+    corner.position = resolveIndex(p, positionCount);
+    corner.normal = -1;
+    if (*end == '/')
+    {
+        const char* rest = end + 1;
+        strtol(rest, &end, 10);   // texture coordinates are not used
+        if (*end == '/')
+        {
+            long n = strtol(end + 1, &end, 10);
+            corner.normal = resolveIndex(n, normalCount);
+        }
+    }
+    return corner.position >= 0 && corner.position < (int)positionCount
+        && corner.normal < (int)normalCount;
+}
+
+static Vec3 normalize(Vec3 v)
+{
+    float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (length == 0.0f)
+    {
+        Vec3 up = { 0.0f, 1.0f, 0.0f };
+        return up;
+    }
+    Vec3 n = { v.x / length, v.y / length, v.z / length };
+    return n;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cout << "usage: obj2mesh input.obj output.mesh" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1]);
+    if (!in)
+    {
+        std::cout << "ERROR::OBJ2MESH::FILE_NOT_SUCCESSFULLY_READ: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::vector<Vec3> positions, normals;
+    std::vector<Corner> corners;        // three per triangle
+    std::vector<Corner> polygon;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+        const char* s = line.c_str();
+        if (s[0] == 'v' && s[1] == ' ')
+        {
+            Vec3 v = { 0.0f, 0.0f, 0.0f };
+            sscanf(s + 2, "%f %f %f", &v.x, &v.y, &v.z);
+            positions.push_back(v);
+        }
+        else if (s[0] == 'v' && s[1] == 'n' && s[2] == ' ')
+        {
+            Vec3 n = { 0.0f, 0.0f, 0.0f };
+            sscanf(s + 3, "%f %f %f", &n.x, &n.y, &n.z);
+            normals.push_back(n);
+        }
+        else if (s[0] == 'f' && s[1] == ' ')
+        {
+            polygon.clear();
+            char token[64];
+            int consumed = 0;
+            const char* cursor = s + 2;
+            while (sscanf(cursor, "%63s%n", token, &consumed) == 1)
+            {
+                Corner corner;
+                if (!parseCorner(token, positions.size(), normals.size(), corner))
+                {
+                    std::cout << "ERROR::OBJ2MESH::BAD_FACE: line " << lineNumber << std::endl;
+                    return 1;
+                }
+                polygon.push_back(corner);
+                cursor += consumed;
+            }
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                corners.push_back(polygon[0]);
+                corners.push_back(polygon[i - 1]);
+                corners.push_back(polygon[i]);
+            }
+        }
+    }
+    if (corners.empty())
+    {
+        std::cout << "ERROR::OBJ2MESH::NO_TRIANGLES: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // corners without a normal get the area-weighted average of the faces around their position
+    std::vector<Vec3> faceNormals(positions.size());
+    memset(faceNormals.data(), 0, faceNormals.size() * sizeof(Vec3));
+    for (size_t t = 0; t < corners.size(); t += 3)
+    {
+        const Vec3& a = positions[corners[t].position];
+        const Vec3& b = positions[corners[t + 1].position];
+        const Vec3& c = positions[corners[t + 2].position];
+        Vec3 ab = { b.x - a.x, b.y - a.y, b.z - a.z };
+        Vec3 ac = { c.x - a.x, c.y - a.y, c.z - a.z };
+        Vec3 cross = { ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x };
+        for (int k = 0; k < 3; k++)
+        {
+            Vec3& n = faceNormals[corners[t + k].position];
+            n.x += cross.x;
+            n.y += cross.y;
+            n.z += cross.z;
+        }
+    }
+
+    float boundsMin[3] = { positions[corners[0].position].x, positions[corners[0].position].y, positions[corners[0].position].z };
+    float boundsMax[3] = { boundsMin[0], boundsMin[1], boundsMin[2] };
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        const Vec3& p = positions[corners[i].position];
+        const float v[3] = { p.x, p.y, p.z };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            boundsMin[axis] = std::min(boundsMin[axis], v[axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], v[axis]);
+        }
+    }
+    // a flat mesh gets a thin grid on its flat axis; the header carries the padded bounds
+    padMeshBounds(boundsMin, boundsMax);
+
+    // weld: one vertex per distinct (position, normal) pair
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t> indices;
+    indices.reserve(corners.size());
+    std::unordered_map<uint64_t, uint32_t> welded;
+    float maxError = 0.0f;
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        const Corner& corner = corners[i];
+        uint64_t key = ((uint64_t)(uint32_t)corner.position << 32) | (uint32_t)(corner.normal + 1);
+        std::unordered_map<uint64_t, uint32_t>::iterator found = welded.find(key);
+        if (found != welded.end())
+        {
+            indices.push_back(found->second);
+            continue;
+        }
+
+        const Vec3& p = positions[corner.position];
+        Vec3 n = normalize(corner.normal >= 0 ? normals[corner.normal] : faceNormals[corner.position]);
+        PackedVertex vertex;
+        vertex.position[0] = quantizeMeshPosition(p.x, boundsMin[0], boundsMax[0]);
+        vertex.position[1] = quantizeMeshPosition(p.y, boundsMin[1], boundsMax[1]);
+        vertex.position[2] = quantizeMeshPosition(p.z, boundsMin[2], boundsMax[2]);
+        vertex.padding = 0;
+        vertex.normal = packMeshNormal(n.x, n.y, n.z);
+
+        const float v[3] = { p.x, p.y, p.z };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float center = (boundsMin[axis] + boundsMax[axis]) * 0.5f;
+            float half = (boundsMax[axis] - boundsMin[axis]) * 0.5f;
+            float decoded = center + vertex.position[axis] * (half / (float)MESH_POSITION_RANGE);
+            maxError = std::max(maxError, std::fabs(decoded - v[axis]));
+        }
+
+        uint32_t index = (uint32_t)vertices.size();
+        welded[key] = index;
+        vertices.push_back(vertex);
+        indices.push_back(index);
+    }
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESH_FILE_MAGIC, 4);
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = (uint32_t)vertices.size();
+    header.indexCount = (uint32_t)indices.size();
+    header.indexSize = vertices.size() <= 65536 ? 2 : 4;
+    header.vertexOffset = alignMeshOffset(sizeof(MeshFileHeader));
+    header.indexOffset = alignMeshOffset(header.vertexOffset + (uint32_t)(vertices.size() * sizeof(PackedVertex)));
+    for (int axis = 0; axis < 3; axis++)
+    {
+        header.boundsMin[axis] = boundsMin[axis];
+        header.boundsMax[axis] = boundsMax[axis];
+    }
+
+    std::vector<unsigned char> file(header.indexOffset + indices.size() * header.indexSize, 0);
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + header.vertexOffset, vertices.data(), vertices.size() * sizeof(PackedVertex));
+    unsigned char* indexBlock = file.data() + header.indexOffset;
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (header.indexSize == 2)
+        {
+            uint16_t index = (uint16_t)indices[i];
+            memcpy(indexBlock + i * 2, &index, 2);
+        }
+        else
+            memcpy(indexBlock + i * 4, &indices[i], 4);
+    }
+
+    std::ofstream out(argv[2], std::ios::binary);
+    out.write((const char*)file.data(), (std::streamsize)file.size());
+    if (!out)
+    {
+        std::cout << "ERROR::OBJ2MESH::FILE_NOT_SUCCESSFULLY_WRITTEN: " << argv[2] << std::endl;
+        return 1;
+    }
+
+    // what the same mesh costs unwelded with float positions and normals and 32-bit indices
+    size_t floatBytes = corners.size() * 6 * sizeof(float) + corners.size() * sizeof(uint32_t);
+    std::cout << argv[2] << ": " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, "
+              << header.indexSize * 8 << "-bit indices, " << file.size() << " bytes ("
+              << floatBytes << " as unwelded floats), max position error " << maxError << std::endl;
+    return 0;
+}
@@ -0,0 +1,119 @@
+//
+//  transform_kernel.h
+//  3D Object Drawing
+//
+//  World/model matrix composition for the scene graph, one node at a time
+//  over a list of nodes. Every node is a translation followed by a yaw, and
+//  boxes add an offset and a scale, so instead of building and multiplying
+//  full 4x4 matrices the columns are composed directly: a yaw only mixes the
+//  parent's X and Z columns, a translation is one column combination, and a
+//  scale multiplies columns. Each column is one SSE register (scalar
+//  fallback elsewhere); the SIMD runs across the columns of one matrix, not
+//  across nodes. Four nodes per iteration in structure-of-arrays lanes with
+//  a polynomial sincos was measured slower: the arithmetic per node is the
+//  same, the matrices have to be transposed in and out of the lanes, and
+//  libm's sincosf is cheap next to that.
+//
+
+#ifndef TRANSFORM_KERNEL_H
+#define TRANSFORM_KERNEL_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_USE_SSE 1
+#endif
+
+// world[n] = world[parent[n]] * translate(position[n]) * rotateY(yaw[n])   (parent -1: no parent term)
+// model[n] = world[n] * translate(boxOffset[n]) * scale(boxScale[n])
+// for n = nodes[0 .. count); a node's parent must either come earlier in nodes or be up to date already.
+// yaw is in degrees, and rotateY keeps the room's convention of sin at [0][2] and -sin at [2][0].
+// ------------------------------------------------------------------------
+inline void composeTransforms(const int* nodes, size_t count, const int* parent,
+                              const glm::vec3* position, const float* yaw,
+                              const glm::vec3* boxOffset, const glm::vec3* boxScale,
+                              glm::mat4* world, glm::mat4* model)
+{
+    const float degreesToRadians = 0.01745329251994329577f;
+    for (size_t i = 0; i < count; i++)
+    {
+        int node = nodes[i];
+        // most nodes are not rotated; skip the trigonometry for them
+        float c = 1.0f, s = 0.0f;
+        if (yaw[node] != 0.0f)
+        {
+            float radians = yaw[node] * degreesToRadians;
+            c = std::cos(radians);
+            s = std::sin(radians);
+        }
+        const glm::vec3& t = position[node];
+        const glm::vec3& o = boxOffset[node];
+        const glm::vec3& k = boxScale[node];
+
+#ifdef TRANSFORM_USE_SSE
+        __m128 p0, p1, p2, p3;
+        if (parent[node] == -1)
+        {
+            p0 = _mm_setr_ps(1.0f, 0.0f, 0.0f, 0.0f);
+            p1 = _mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f);
+            p2 = _mm_setr_ps(0.0f, 0.0f, 1.0f, 0.0f);
+            p3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+        else
+        {
+            const float* p = &world[parent[node]][0][0];
+            p0 = _mm_loadu_ps(p);
+            p1 = _mm_loadu_ps(p + 4);
+            p2 = _mm_loadu_ps(p + 8);
+            p3 = _mm_loadu_ps(p + 12);
+        }
+        __m128 cosine = _mm_set1_ps(c), sine = _mm_set1_ps(s);
+
+        // rotateY columns are (c, 0, s), (0, 1, 0), (-s, 0, c); the translation lands in column 3
+        __m128 w0 = _mm_add_ps(_mm_mul_ps(p0, cosine), _mm_mul_ps(p2, sine));
+        __m128 w1 = p1;
+        __m128 w2 = _mm_sub_ps(_mm_mul_ps(p2, cosine), _mm_mul_ps(p0, sine));
+        __m128 w3 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(t.x)), _mm_mul_ps(p1, _mm_set1_ps(t.y))),
+                               _mm_add_ps(_mm_mul_ps(p2, _mm_set1_ps(t.z)), p3));
+        float* w = &world[node][0][0];
+        _mm_storeu_ps(w, w0);
+        _mm_storeu_ps(w + 4, w1);
+        _mm_storeu_ps(w + 8, w2);
+        _mm_storeu_ps(w + 12, w3);
+
+        float* m = &model[node][0][0];
+        _mm_storeu_ps(m, _mm_mul_ps(w0, _mm_set1_ps(k.x)));
+        _mm_storeu_ps(m + 4, _mm_mul_ps(w1, _mm_set1_ps(k.y)));
+        _mm_storeu_ps(m + 8, _mm_mul_ps(w2, _mm_set1_ps(k.z)));
+        _mm_storeu_ps(m + 12, _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(o.x)), _mm_mul_ps(w1, _mm_set1_ps(o.y))),
+                                         _mm_add_ps(_mm_mul_ps(w2, _mm_set1_ps(o.z)), w3)));
+#else
+        glm::vec4 p0(1.0f, 0.0f, 0.0f, 0.0f), p1(0.0f, 1.0f, 0.0f, 0.0f), p2(0.0f, 0.0f, 1.0f, 0.0f), p3(0.0f, 0.0f, 0.0f, 1.0f);
+        if (parent[node] != -1)
+        {
+            const glm::mat4& p = world[parent[node]];
+            p0 = p[0];
+            p1 = p[1];
+            p2 = p[2];
+            p3 = p[3];
+        }
+        glm::mat4& w = world[node];
+        w[0] = p0 * c + p2 * s;
+        w[1] = p1;
+        w[2] = p2 * c - p0 * s;
+        w[3] = p0 * t.x + p1 * t.y + (p2 * t.z + p3);
+
+        glm::mat4& m = model[node];
+        m[0] = w[0] * k.x;
+        m[1] = w[1] * k.y;
+        m[2] = w[2] * k.z;
+        m[3] = w[0] * o.x + w[1] * o.y + (w[2] * o.z + w[3]);
+#endif
+    }
+}
+
+#endif
@@ -1,15 +1,42 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
+layout (location = 7) in vec3 aNormal;
+layout (location = 8) in vec3 aNormalScale;     // one, except for quantized meshes (mesh_asset.h)
 
 out vec4 color;
+#ifdef LIGHTING
+out vec3 viewPosition;
+out vec3 viewNormal;
+#endif
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+#ifdef LIGHTING
+// the models are a rotation times an uneven (possibly mirrored) scale, never a shear, so the inverse
+// transpose is the matrix itself with every column divided by its squared length: no per-vertex inverse
+vec3 transformNormal(mat3 m, vec3 n)
+{
+    return m * (n / vec3(dot(m[0], m[0]), dot(m[1], m[1]), dot(m[2], m[2])));
+}
+#endif
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
+    vec4 worldPosition = model * vec4(aPos, 1.0f);
+    gl_Position = viewProjection * worldPosition;
     color = vec4(aColor, 1.0f);
+#ifdef LIGHTING
+    viewPosition = vec3(view * worldPosition);
+    viewNormal = mat3(view) * transformNormal(mat3(model), aNormal * aNormalScale);
+#endif
 }
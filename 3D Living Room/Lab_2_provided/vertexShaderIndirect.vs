@@ -0,0 +1,51 @@
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+layout (location = 0) in vec3 aPos;
+layout (location = 7) in vec3 aNormal;
+
+out vec4 color;
+#ifdef LIGHTING
+out vec3 viewPosition;
+out vec3 viewNormal;
+#endif
+
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+// one entry per command of the multi-draw, see indirect_batch.h
+struct DrawRecord
+{
+    mat4 model;
+    vec4 color;
+};
+
+layout (std430, binding = 1) readonly buffer DrawRecords
+{
+    DrawRecord draws[];
+};
+
+#ifdef LIGHTING
+// rotation times scale: the inverse transpose is m with every column divided by its squared length
+vec3 transformNormal(mat3 m, vec3 n)
+{
+    return m * (n / vec3(dot(m[0], m[0]), dot(m[1], m[1]), dot(m[2], m[2])));
+}
+#endif
+
+void main()
+{
+    DrawRecord record = draws[gl_DrawIDARB];
+    vec4 worldPosition = record.model * vec4(aPos, 1.0f);
+    gl_Position = viewProjection * worldPosition;
+    color = record.color;
+#ifdef LIGHTING
+    viewPosition = vec3(view * worldPosition);
+    viewNormal = mat3(view) * transformNormal(mat3(record.model), aNormal);
+#endif
+}
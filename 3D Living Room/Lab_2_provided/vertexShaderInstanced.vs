@@ -0,0 +1,39 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in mat4 aModel;
+layout (location = 6) in vec4 aColor;
+layout (location = 7) in vec3 aNormal;
+
+out vec4 color;
+#ifdef LIGHTING
+out vec3 viewPosition;
+out vec3 viewNormal;
+#endif
+
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+#ifdef LIGHTING
+// rotation times scale: the inverse transpose is m with every column divided by its squared length
+vec3 transformNormal(mat3 m, vec3 n)
+{
+    return m * (n / vec3(dot(m[0], m[0]), dot(m[1], m[1]), dot(m[2], m[2])));
+}
+#endif
+
+void main()
+{
+    vec4 worldPosition = aModel * vec4(aPos, 1.0f);
+    gl_Position = viewProjection * worldPosition;
+    color = aColor;
+#ifdef LIGHTING
+    viewPosition = vec3(view * worldPosition);
+    viewNormal = mat3(view) * transformNormal(mat3(aModel), aNormal);
+#endif
+}